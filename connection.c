@@ -1,84 +1,457 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/wait.h>
+
 #include "connection.h"
 
+#define DNS_UNRESOLVED 0
+#define DNS_RESOLVED 1
+#define DNS_FAILED 2
+#define DNS_PENDING 3
+
+/* Result of a lookup, sent from the lookup process to the crawler. */
+typedef struct DnsResult {
+    int status;
+    socklen_t address_length;
+    struct sockaddr_storage address;
+} DnsResult;
+
+
+static void set_port(struct sockaddr_storage *address, u_int16_t port)
+{
+    if (address->ss_family == AF_INET)
+        ((struct sockaddr_in *) address)->sin_port = htons(port);
+    else if (address->ss_family == AF_INET6)
+        ((struct sockaddr_in6 *) address)->sin6_port = htons(port);
+}
+
+/**
+ * @brief Switch a file descriptor to non-blocking mode.
+ *
+ * @param fd file descriptor
+ * @return int 0 on success, -1 if an error occured
+ */
+int set_non_blocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    return flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Run getaddrinfo in a child process, so a slow name server does not block the crawl.
+ *  The child writes a single DnsResult into the pipe, which fits into PIPE_BUF and is therefore
+ *  read in one piece.
+ *
+ * @param entry entry of the host, set to DNS_PENDING
+ * @param node node to be resolved
+ * @return int 0 if the lookup has been started, -1 otherwise
+ */
+static int start_lookup(DnsEntry *entry, const char *node)
+{
+    int fds[2];
+
+    if (pipe(fds) == -1)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        DnsResult result;
+        struct addrinfo hints;
+        struct addrinfo *addresses;
+
+        close(fds[0]);
+        memset(&result, 0, sizeof(result));
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        result.status = getaddrinfo(node, NULL, &hints, &addresses);
+        if (result.status == 0) {
+            memcpy(&result.address, addresses->ai_addr, addresses->ai_addrlen);
+            result.address_length = addresses->ai_addrlen;
+            freeaddrinfo(addresses);
+        }
+
+        //_exit, the child must not flush or free anything of the crawler
+        _exit(write(fds[1], &result, sizeof(result)) == sizeof(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    set_non_blocking(fds[0]);
+
+    entry->state = DNS_PENDING;
+    entry->lookup_fd = fds[0];
+    entry->lookup_pid = pid;
+
+    return 0;
+}
+
+static void finish_lookup(DnsEntry *entry)
+{
+    close(entry->lookup_fd);
+    waitpid(entry->lookup_pid, NULL, 0);
+
+    entry->lookup_fd = -1;
+    entry->lookup_pid = 0;
+}
 
 /**
- * @brief Make connection based on node and port.
- * 
+ * @brief Resolve the node, each host is only looked up once and then served from the cache.
+ *  Failed lookups are cached as well. The lookup runs in the background, while it is running
+ *  the caller has to wait until dns_lookup_fd becomes readable and then call this again.
+ *
+ * @param cache cache of resolved hosts
+ * @param host_id id of the interned node
  * @param node node (e.g. www.example.com)
  * @param port port (e.g. 443)
- * @return int number > 0 (filedescriptor) if connection
- *  was established; -1 if unable to establish connection.
+ * @param address filled with the address of the node
+ * @param address_length filled with the length of the address
+ * @return int 0 if the node was resolved, CONNECTION_WANT_READ if the lookup is still running,
+ *  CONNECTION_NO_MEMORY if the memory cap has been reached, -1 if the node could not be resolved
  */
-int establish_connection(const char *node, const char *port)
+int resolve_node(DnsCache *cache, u_int32_t host_id, const char *node, u_int16_t port,
+    struct sockaddr_storage *address, socklen_t *address_length)
 {
-    struct addrinfo hints;
-    struct addrinfo *result;
+    if (host_id >= cache->size) {
+        u_int32_t size = cache->size ? cache->size : 16;
+        while (size <= host_id)
+            size *= 2;
 
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+        DnsEntry *entries = mem_realloc(MEMORY_DNS, cache->entries, size * sizeof(DnsEntry));
+        if (!entries)
+            return CONNECTION_NO_MEMORY;
 
-    int getaddrinfo_res = getaddrinfo(node, port, &hints, &result);
-    if (getaddrinfo_res != 0) {
-        fprintf(stderr, "[ERROR]: ./spoder: getaddrinfo failed: %s\n", gai_strerror(getaddrinfo_res));
-        exit(EXIT_FAILURE);
+        cache->entries = entries;
+
+        memset(&cache->entries[cache->size], 0, (size - cache->size) * sizeof(DnsEntry));
+        for (u_int32_t i = cache->size; i < size; ++i)
+            cache->entries[i].lookup_fd = -1;
+        cache->size = size;
+    }
+
+    DnsEntry *entry = &cache->entries[host_id];
+
+    if (entry->state == DNS_UNRESOLVED && start_lookup(entry, node) < 0) {
+        fprintf(stderr, "[WARNING]: ./spoder: unable to start the lookup of %s: %s\n", node, strerror(errno));
+        entry->state = DNS_FAILED;
+        return -1;
+    }
+
+    if (entry->state == DNS_PENDING) {
+        DnsResult result;
+        ssize_t bytes = read(entry->lookup_fd, &result, sizeof(result));
+
+        if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return CONNECTION_WANT_READ;
+
+        finish_lookup(entry);
+        entry->state = DNS_FAILED;
+
+        if (bytes != sizeof(result)) {
+            fprintf(stderr, "[WARNING]: ./spoder: lookup of %s failed\n", node);
+            return -1;
+        }
+
+        if (result.status != 0) {
+            fprintf(stderr, "[WARNING]: ./spoder: getaddrinfo failed for %s: %s\n", node, gai_strerror(result.status));
+            return -1;
+        }
+
+        memcpy(&entry->address, &result.address, result.address_length);
+        entry->address_length = result.address_length;
+        entry->state = DNS_RESOLVED;
+    }
+
+    if (entry->state == DNS_FAILED)
+        return -1;
+
+    memcpy(address, &entry->address, entry->address_length);
+    *address_length = entry->address_length;
+    set_port(address, port);
+
+    return 0;
+}
+
+/**
+ * @brief Get the file descriptor that becomes readable once the lookup of the host is done.
+ *
+ * @param cache cache of resolved hosts
+ * @param host_id id of the interned node
+ * @return int the file descriptor, -1 if no lookup of the host is running
+ */
+int dns_lookup_fd(const DnsCache *cache, u_int32_t host_id)
+{
+    if (host_id >= cache->size || cache->entries[host_id].state != DNS_PENDING)
+        return -1;
+
+    return cache->entries[host_id].lookup_fd;
+}
+
+/**
+ * @brief Empty the cache, running lookups are cancelled.
+ *
+ * @param cache cache of resolved hosts
+ */
+void dns_cache_free(DnsCache *cache)
+{
+    for (u_int32_t i = 0; i < cache->size; ++i) {
+        if (cache->entries[i].state == DNS_PENDING) {
+            kill(cache->entries[i].lookup_pid, SIGKILL);
+            finish_lookup(&cache->entries[i]);
+        }
     }
 
-    int socket_fd = -1;
-    struct addrinfo *rp;
-    for(rp = result; rp != NULL; rp = rp->ai_next) {
-        socket_fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+    mem_free(cache->entries);
+    cache->entries = NULL;
+    cache->size = 0;
+}
+
+/**
+ * @brief Start connecting to the given address without blocking.
+ *
+ * @param connection filled with the non-blocking socket
+ * @param address address to connect to
+ * @param address_length length of the address
+ * @return int 0 if the connection was established, CONNECTION_WANT_WRITE if the socket has
+ *  to become writable before calling finish_connection, -1 if unable to connect.
+ */
+int start_connection(Connection *connection, const struct sockaddr *address, socklen_t address_length)
+{
+    connection->ssl = NULL;
+    connection->socket_fd = socket(address->sa_family, SOCK_STREAM, 0);
+
+    if (connection->socket_fd == -1)
+        return -1;
+
+    if (set_non_blocking(connection->socket_fd) == -1)
+        return -1;
+
+    if (connect(connection->socket_fd, address, address_length) == 0)
+        return 0;
 
-        if (socket_fd == -1)
-            continue;
+    if (errno == EINPROGRESS)
+        return CONNECTION_WANT_WRITE;
 
-        if (connect(socket_fd, rp->ai_addr, rp->ai_addrlen) != -1)
-            break;
+    return -1;
+}
+
+/**
+ * @brief Check the result of a connect that was started with start_connection.
+ *
+ * @param connection connection whose socket became writable
+ * @return int 0 if the connection was established, -1 otherwise (errno is set)
+ */
+int finish_connection(Connection *connection)
+{
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+
+    if (getsockopt(connection->socket_fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1)
+        return -1;
+
+    if (error != 0) {
+        errno = error;
+        return -1;
     }
 
-    if (rp == NULL)
-        socket_fd = -1;
+    return 0;
+}
+
+static void *ssl_malloc(size_t size, const char *file, int line)
+{
+    return mem_alloc(MEMORY_CONNECTION, size);
+}
 
-    freeaddrinfo(result);
+static void *ssl_realloc(void *ptr, size_t size, const char *file, int line)
+{
+    return mem_realloc(MEMORY_CONNECTION, ptr, size);
+}
 
-    return socket_fd;
+static void ssl_free(void *ptr, const char *file, int line)
+{
+    mem_free(ptr);
 }
 
 /**
- * @brief Initialize ssl context.
- * 
+ * @brief Initialize ssl context. The memory used by OpenSSL is accounted to the connections,
+ *  so this has to be called before anything else uses OpenSSL.
+ *
  * @return SSL_CTX* pointer to context struct
  */
 SSL_CTX *initialize_ssl_context(void)
 {
+    //Fails if OpenSSL has already allocated memory, it then keeps using malloc and free
+    CRYPTO_set_mem_functions(ssl_malloc, ssl_realloc, ssl_free);
+
     SSL_library_init();
     OpenSSL_add_all_algorithms();
     SSL_load_error_strings();
 
-    return SSL_CTX_new(TLS_client_method());
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    //Plenty of servers close the connection without sending close_notify
+    if (ctx)
+        SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    return ctx;
 }
 
 /**
- * @brief Fill ssl connection object
- * 
- * @param ssl struct to be filled
+ * @brief Create the ssl object for an established connection and start the handshake.
+ *
+ * @param connection established connection
  * @param ctx context
- * @param socket_fd file descriptor for connection
- * @return int negative number if error occured, positive number otherwise
+ * @param node node, used for server name indication
+ * @return int 0 if the handshake is complete, CONNECTION_WANT_READ or CONNECTION_WANT_WRITE
+ *  if continue_ssl_handshake has to be called once the socket is ready, -1 if an error occured
  */
-int create_ssl_connection(SSL **ssl, SSL_CTX *ctx, u_int32_t socket_fd)
+int start_ssl_connection(Connection *connection, SSL_CTX *ctx, const char *node)
 {
+    connection->ssl = SSL_new(ctx);
+    if (!connection->ssl)
+        return -1;
 
-    *ssl = SSL_new(ctx);
-    if (!*ssl)
+    if (!SSL_set_fd(connection->ssl, connection->socket_fd))
         return -1;
-    
-    int set_fd_result = SSL_set_fd(*ssl, socket_fd);
-    if (!set_fd_result)
-        return -2;
 
-    if (SSL_connect(*ssl) <= 0)
-        return -3;
+    SSL_set_tlsext_host_name(connection->ssl, node);
+
+    //TODO: allow for certificate validation
+
+    return continue_ssl_handshake(connection);
+}
+
+static int map_ssl_error(Connection *connection, int ret)
+{
+    switch (SSL_get_error(connection->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return CONNECTION_WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return CONNECTION_WANT_WRITE;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            //EOF without close_notify on older OpenSSL versions
+            if (ret == 0 && errno == 0)
+                return 0;
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Continue a handshake that was started with start_ssl_connection.
+ *
+ * @param connection connection
+ * @return int see start_ssl_connection
+ */
+int continue_ssl_handshake(Connection *connection)
+{
+    ERR_clear_error();
+    errno = 0;
+
+    int ret = SSL_connect(connection->ssl);
+    if (ret == 1)
+        return 0;
+
+    int error = map_ssl_error(connection, ret);
+    return error == 0 ? -1 : error;
+}
+
+/**
+ * @brief Read from the connection without blocking, using ssl if the connection has been
+ *  upgraded.
+ *
+ * @param connection connection
+ * @param buffer buffer to be filled
+ * @param length size of the buffer
+ * @return ssize_t number of bytes read, 0 if the peer closed the connection,
+ *  CONNECTION_WANT_READ or CONNECTION_WANT_WRITE if no data is available right now
+ *  and -1 if an error occured
+ */
+ssize_t connection_read(Connection *connection, char *buffer, size_t length)
+{
+    if (connection->ssl) {
+        ERR_clear_error();
+        errno = 0;
+
+        int bytes = SSL_read(connection->ssl, buffer, (int) length);
+        if (bytes > 0)
+            return bytes;
+
+        return map_ssl_error(connection, bytes);
+    }
+
+    ssize_t bytes = read(connection->socket_fd, buffer, length);
+    if (bytes >= 0)
+        return bytes;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return CONNECTION_WANT_READ;
+
+    return -1;
+}
+
+/**
+ * @brief Write to the connection without blocking, see connection_read.
+ *
+ * @param connection connection
+ * @param buffer data to be written
+ * @param length length of the data
+ * @return ssize_t number of bytes written, CONNECTION_WANT_READ or CONNECTION_WANT_WRITE if
+ *  the connection is not ready and -1 if an error occured
+ */
+ssize_t connection_write(Connection *connection, const char *buffer, size_t length)
+{
+    if (connection->ssl) {
+        ERR_clear_error();
+        errno = 0;
 
-    return 1;
-}
\ No newline at end of file
+        int bytes = SSL_write(connection->ssl, buffer, (int) length);
+        if (bytes > 0)
+            return bytes;
+
+        int error = map_ssl_error(connection, bytes);
+        return error == 0 ? -1 : error;
+    }
+
+    ssize_t bytes = write(connection->socket_fd, buffer, length);
+    if (bytes >= 0)
+        return bytes;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return CONNECTION_WANT_WRITE;
+
+    return -1;
+}
+
+/**
+ * @brief Shut down the connection and release its resources.
+ *
+ * @param connection connection
+ */
+void close_connection(Connection *connection)
+{
+    if (connection->ssl) {
+        SSL_shutdown(connection->ssl);
+        SSL_free(connection->ssl);
+        connection->ssl = NULL;
+    }
+
+    if (connection->socket_fd >= 0) {
+        close(connection->socket_fd);
+        connection->socket_fd = -1;
+    }
+}
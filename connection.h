@@ -1,3 +1,6 @@
+#ifndef LIBCONNECTION
+#define LIBCONNECTION
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -11,8 +14,52 @@
 
 #include "utilities.h"
 
-int establish_connection(const char *node, const char *port);
+#define CONNECTION_WANT_READ -2
+#define CONNECTION_WANT_WRITE -3
+#define CONNECTION_NO_MEMORY -4
+
+typedef struct Connection {
+    int socket_fd;
+    SSL *ssl;
+} Connection;
+
+typedef struct DnsEntry {
+    u_int8_t state;
+    int lookup_fd;                  /* read end of the pipe the lookup process reports to, -1 if none */
+    pid_t lookup_pid;
+    socklen_t address_length;
+    struct sockaddr_storage address;
+} DnsEntry;
+
+/* Resolved addresses, indexed by the id of the interned host. */
+typedef struct DnsCache {
+    DnsEntry *entries;
+    u_int32_t size;
+} DnsCache;
+
+int resolve_node(DnsCache *cache, u_int32_t host_id, const char *node, u_int16_t port,
+    struct sockaddr_storage *address, socklen_t *address_length);
+
+int dns_lookup_fd(const DnsCache *cache, u_int32_t host_id);
+
+void dns_cache_free(DnsCache *cache);
+
+int set_non_blocking(int fd);
+
+int start_connection(Connection *connection, const struct sockaddr *address, socklen_t address_length);
+
+int finish_connection(Connection *connection);
 
 SSL_CTX *initialize_ssl_context(void);
 
-int create_ssl_connection(SSL **ssl, SSL_CTX *ctx, u_int32_t socket_fd);
\ No newline at end of file
+int start_ssl_connection(Connection *connection, SSL_CTX *ctx, const char *node);
+
+int continue_ssl_handshake(Connection *connection);
+
+ssize_t connection_read(Connection *connection, char *buffer, size_t length);
+
+ssize_t connection_write(Connection *connection, const char *buffer, size_t length);
+
+void close_connection(Connection *connection);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,638 @@
+#include <ctype.h>
+#include <stdint.h>
+
+#include "fetch.h"
+
+#define HEADER_BUFFER_SIZE 1024
+#define HEADER_SIZE_LIMIT (64 * 1024)
+
+
+static void handle_text(void *context, const char *text, size_t length)
+{
+    FetchTask *task = context;
+
+    if (task->context->on_text)
+        task->context->on_text(task->context->owner, task, text, length);
+}
+
+static void handle_link(void *context, const char *link, size_t length)
+{
+    FetchTask *task = context;
+
+    if (resolve_url(task->url.data, &task->components, link, length, &task->link) < 0)
+        return;
+
+    if (task->context->on_link)
+        task->context->on_link(task->context->owner, task, task->link.data, task->link.used_size, 0);
+}
+
+/**
+ * @brief Create a task fetching the given url. The task does not do anything until
+ *  fetch_task_step is called.
+ *
+ * @param context context shared by all tasks
+ * @param url normalized http or https url, does not have to be null terminated
+ * @param length length of the url
+ * @param depth depth of the url, passed on to the owner together with the found links
+ * @return FetchTask* the task, NULL if the url could not be parsed (errno is set to EINVAL) or
+ *  the memory cap has been reached (errno is set to ENOMEM). If the memory cap is reached
+ *  after the task has been created, the task fails on its first step.
+ */
+FetchTask *fetch_task_create(FetchContext *context, const char *url, size_t length, u_int32_t depth)
+{
+    FetchTask *task = mem_calloc(MEMORY_CONNECTION, 1, sizeof(FetchTask));
+    if (!task)
+        return NULL;
+
+    task->state = FETCH_RESOLVE;
+    task->context = context;
+    task->depth = depth;
+    task->connection.socket_fd = -1;
+    task->replay.fd = -1;
+    task->content_remaining = -1;
+    task->is_html = 1;
+
+    task->captured.subsystem = MEMORY_REPLAY;
+
+    if (text_buffer_append(&task->url, url, length) < 0) {
+        fetch_task_free(task);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (parse_url(task->url.data, task->url.used_size, &task->components) < 0
+        || task->components.host.length == 0
+        || (task->port = url_port(task->url.data, &task->components)) == 0) {
+        fetch_task_free(task);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    task->is_https = task->components.scheme.length == 5;
+    task->host_id = host_table_intern(context->hosts, &task->url.data[task->components.host.offset],
+        task->components.host.length);
+
+    //path (and query) are everything after the authority, the fragment has been removed
+    const char *path = &task->url.data[task->components.path.offset];
+    size_t path_length = task->url.used_size - task->components.path.offset;
+    const char *authority = &task->url.data[task->components.host.offset];
+    size_t authority_length = task->components.path.offset - task->components.host.offset;
+
+    if (task->host_id == HOST_TABLE_FULL
+        || text_buffer_reserve(&task->request, 4 + path_length + 17 + authority_length + 43) < 0
+        || text_buffer_reserve(&task->headers, HEADER_BUFFER_SIZE - 1) < 0
+        || text_buffer_reserve(&task->body, FETCH_BUFFER_SIZE) < 0
+        || html_parser_init(&task->parser, handle_text, handle_link, task) < 0) {
+        task->state = FETCH_FAILED;
+        task->error = MEMORY_CAP_REACHED;
+        return task;
+    }
+
+    text_buffer_append(&task->request, "GET ", 4);
+    text_buffer_append(&task->request, path, path_length);
+    text_buffer_append(&task->request, " HTTP/1.1\r\nHost: ", 17);
+    text_buffer_append(&task->request, authority, authority_length);
+    text_buffer_append(&task->request, "\r\nConnection: close\r\nUser-Agent: Spoder\r\n\r\n", 43);
+
+    text_buffer_reset(&task->headers);
+    text_buffer_reset(&task->body);
+
+    return task;
+}
+
+static short fail(FetchTask *task, const char *error)
+{
+    task->error = error;
+    task->state = FETCH_FAILED;
+    close_connection(&task->connection);
+    replay_stream_close(&task->replay);
+
+    return FETCH_FINISHED;
+}
+
+static short wait_for(int connection_result)
+{
+    return connection_result == CONNECTION_WANT_READ ? POLLIN : POLLOUT;
+}
+
+static u_int64_t timeout_after(u_int32_t timeout)
+{
+    return timeout ? monotonic_ms() + timeout : 0;
+}
+
+/**
+ * @brief Wait for the socket while sending or receiving. The read timeout is an idle timeout:
+ *  it starts when the task starts waiting and is cleared as soon as data is transferred, so
+ *  time spent in the parser or paused by the scheduler is not counted.
+ */
+static short wait_for_transfer(FetchTask *task, int connection_result)
+{
+    if (task->timeout_at == 0)
+        task->timeout_at = timeout_after(task->context->read_timeout);
+
+    return wait_for(connection_result);
+}
+
+/**
+ * @brief Get the file descriptor the task waits for, which is the pipe of the dns lookup
+ *  while the host is resolved and the socket afterwards.
+ *
+ * @param task task
+ * @return int the file descriptor, -1 if the task does not have to wait for anything
+ */
+int fetch_task_fd(const FetchTask *task)
+{
+    if (task->state == FETCH_RESOLVE)
+        return dns_lookup_fd(&task->context->dns_cache, task->host_id);
+
+    return task->connection.socket_fd;
+}
+
+/**
+ * @brief Fail the task because the timeout of its current state has expired.
+ *
+ * @param task task whose timeout_at has passed
+ */
+void fetch_task_timeout(FetchTask *task)
+{
+    switch (task->state) {
+        case FETCH_RESOLVE:
+            fail(task, "dns lookup timed out");
+            break;
+        case FETCH_CONNECT:
+            fail(task, "connect timed out");
+            break;
+        case FETCH_HANDSHAKE:
+            fail(task, "ssl handshake timed out");
+            break;
+        default:
+            fail(task, "read timed out");
+            break;
+    }
+}
+
+static int header_name_equals(const char *line, size_t length, const char *name)
+{
+    size_t name_length = strlen(name);
+
+    if (length < name_length + 1 || line[name_length] != ':')
+        return 0;
+
+    for (size_t i = 0; i < name_length; ++i) {
+        if (tolower((unsigned char) line[i]) != name[i])
+            return 0;
+    }
+    return 1;
+}
+
+static int header_value_contains(const char *value, size_t length, const char *token)
+{
+    size_t token_length = strlen(token);
+
+    for (size_t i = 0; i + token_length <= length; ++i) {
+        size_t j = 0;
+        while (j < token_length && tolower((unsigned char) value[i+j]) == token[j])
+            ++j;
+
+        if (j == token_length)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse the status line and the headers that are relevant for reading the body.
+ *
+ * @param task task whose headers have been received completely
+ * @param headers_length length of the headers including the terminating empty line
+ * @return int 0 if the headers are valid, -1 otherwise
+ */
+static int parse_headers(FetchTask *task, size_t headers_length)
+{
+    const char *headers = task->headers.data;
+
+    if (headers_length < 12 || strncmp(headers, "HTTP/1.", 7) != 0 || headers[8] != ' '
+        || !isdigit((unsigned char) headers[9]) || !isdigit((unsigned char) headers[10])
+        || !isdigit((unsigned char) headers[11]))
+        return -1;
+
+    task->status_code = (headers[9] - '0') * 100 + (headers[10] - '0') * 10 + (headers[11] - '0');
+
+    const char *line = strchr(headers, '\n') + 1;
+    const char *end = &headers[headers_length];
+
+    while (line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        size_t line_length = line_end - line;
+
+        if (line_length > 0 && line[line_length-1] == '\r')
+            --line_length;
+
+        const char *value = memchr(line, ':', line_length);
+        if (value) {
+            ++value;
+            while (value < line + line_length && (*value == ' ' || *value == '\t'))
+                ++value;
+        }
+        size_t value_length = value ? (size_t) (line + line_length - value) : 0;
+
+        if (header_name_equals(line, line_length, "content-length")) {
+            char *endptr;
+            long long content_length = strtoll(value, &endptr, 10);
+            if (content_length < 0 || endptr == value)
+                return -1;
+            task->content_remaining = content_length;
+        } else if (header_name_equals(line, line_length, "transfer-encoding")) {
+            task->is_chunked = header_value_contains(value, value_length, "chunked");
+        } else if (header_name_equals(line, line_length, "content-type")) {
+            task->is_html = header_value_contains(value, value_length, "html");
+        } else if (header_name_equals(line, line_length, "location")) {
+            if (task->status_code >= 300 && task->status_code < 400
+                && resolve_url(task->url.data, &task->components, value, value_length, &task->link) == 0
+                && task->context->on_link)
+                task->context->on_link(task->context->owner, task, task->link.data, task->link.used_size, 1);
+        }
+
+        line = line_end + 1;
+    }
+
+    //Content length is meaningless for chunked responses
+    if (task->is_chunked)
+        task->content_remaining = -1;
+
+    return 0;
+}
+
+/**
+ * @brief Append the received body data to the body buffer, removing the chunked transfer
+ *  encoding if necessary, and keep track of whether the whole body has been received.
+ *
+ * @param task task
+ * @param data received body data
+ * @param length length of the data
+ */
+static void decode_body(FetchTask *task, const char *data, size_t length)
+{
+    if (!task->is_chunked) {
+        if (task->content_remaining >= 0 && (long long) length > task->content_remaining)
+            length = (size_t) task->content_remaining;
+
+        if (text_buffer_append(&task->body, data, length) < 0) {
+            task->out_of_memory = 1;
+            return;
+        }
+
+        if (task->content_remaining >= 0) {
+            task->content_remaining -= (long long) length;
+            if (task->content_remaining == 0)
+                task->body_complete = 1;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < length && !task->body_complete; ++i) {
+        char c = data[i];
+
+        switch (task->chunk_state) {
+            case CHUNK_SIZE:
+                if (isxdigit((unsigned char) c)) {
+                    int digit = isdigit((unsigned char) c) ? c - '0' : tolower((unsigned char) c) - 'a' + 10;
+                    //Sizes this large are bogus, the body is cut off
+                    if (task->chunk_remaining > (UINT64_MAX >> 4))
+                        task->body_complete = 1;
+                    task->chunk_remaining = task->chunk_remaining * 16 + digit;
+                    break;
+                }
+                if (c == ';') {
+                    task->chunk_state = CHUNK_EXTENSION;
+                    break;
+                }
+                if (c != '\n')
+                    break;
+                //fall through
+            case CHUNK_EXTENSION:
+                if (c != '\n')
+                    break;
+
+                if (task->chunk_remaining == 0) {
+                    task->chunk_state = CHUNK_TRAILER;
+                    task->trailer_line_length = 0;
+                } else {
+                    task->chunk_state = CHUNK_DATA;
+                }
+                break;
+            case CHUNK_DATA: {
+                size_t available = length - i;
+                size_t take = task->chunk_remaining < available ? (size_t) task->chunk_remaining : available;
+
+                if (text_buffer_append(&task->body, &data[i], take) < 0) {
+                    task->out_of_memory = 1;
+                    return;
+                }
+                task->chunk_remaining -= take;
+                i += take - 1;
+
+                if (task->chunk_remaining == 0)
+                    task->chunk_state = CHUNK_DATA_END;
+                break;
+            }
+            case CHUNK_DATA_END:
+                if (c == '\n')
+                    task->chunk_state = CHUNK_SIZE;
+                break;
+            case CHUNK_TRAILER:
+                if (c == '\n') {
+                    if (task->trailer_line_length == 0)
+                        task->body_complete = 1;
+                    task->trailer_line_length = 0;
+                } else if (c != '\r') {
+                    task->trailer_line_length++;
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Append received data to the headers and check whether all headers have arrived.
+ *  Body data received together with the headers is decoded right away.
+ *
+ * @param task task
+ * @param length number of bytes that were read into the read buffer
+ * @return int 1 if the headers are complete, 0 if more data is needed, -1 if the response is invalid
+ */
+static int receive_headers(FetchTask *task, size_t length)
+{
+    size_t search_start = task->headers.used_size >= 3 ? task->headers.used_size - 3 : 0;
+
+    if (text_buffer_append(&task->headers, task->read_buffer, length) < 0) {
+        task->out_of_memory = 1;
+        return 0;
+    }
+
+    char *terminator = strstr(&task->headers.data[search_start], "\r\n\r\n");
+    if (!terminator) {
+        if (task->headers.used_size > HEADER_SIZE_LIMIT)
+            return -1;
+        return 0;
+    }
+
+    size_t headers_length = (size_t) (terminator - task->headers.data) + 4;
+
+    if (parse_headers(task, headers_length) < 0)
+        return -1;
+
+    if (task->content_remaining == 0 || task->status_code == 204 || task->status_code == 304)
+        task->body_complete = 1;
+
+    decode_body(task, &task->headers.data[headers_length], task->headers.used_size - headers_length);
+
+    return 1;
+}
+
+/**
+ * @brief Connect to the recorded response of the url instead of the server. Recorded
+ *  responses are plain text, so https urls skip the handshake. Only captured urls are
+ *  replayed, an url without recorded response means the replay does not match the capture
+ *  and ends the program.
+ *
+ * @param task task in state FETCH_RESOLVE
+ * @return int 0 if the task can send its request, -1 if the task has failed
+ */
+static int start_replay(FetchTask *task)
+{
+    const char *response;
+    size_t response_length;
+
+    if (replay_find(task->context->replay, task->url.data, task->url.used_size, &response, &response_length) < 0)
+        error_exit_custom("Replayed url has not been captured");
+
+    if (replay_connect(&task->connection, &task->replay, response, response_length) < 0) {
+        fail(task, "unable to connect");
+        return -1;
+    }
+
+    task->state = FETCH_SEND;
+    return 0;
+}
+
+/**
+ * @brief Read the next part of the response, while replaying the recorded response is
+ *  written into the connection right before.
+ */
+static ssize_t receive(FetchTask *task)
+{
+    if (replay_pump(&task->replay) < 0)
+        return -1;
+
+    ssize_t bytes = connection_read(&task->connection, task->read_buffer, FETCH_BUFFER_SIZE);
+
+    if (bytes > 0) {
+        task->timeout_at = 0;
+        task->context->bytes_received += (u_int64_t) bytes;
+
+        if (task->context->capture && text_buffer_append(&task->captured, task->read_buffer, (size_t) bytes) < 0)
+            task->out_of_memory = 1;
+    }
+
+    return bytes;
+}
+
+/**
+ * @brief Run the task until it would block or has parsed a chunk of the body.
+ *
+ * @param task task to be resumed
+ * @return short the poll events (POLLIN or POLLOUT) the task waits for on its socket,
+ *  FETCH_YIELD if the task can be resumed right away or FETCH_FINISHED if the task is done
+ *  or has failed (check task->state and task->error)
+ */
+short fetch_task_step(FetchTask *task)
+{
+    FetchContext *context = task->context;
+    int ret;
+    ssize_t bytes;
+
+    for (;;) {
+        if (task->out_of_memory && task->state != FETCH_DONE && task->state != FETCH_FAILED)
+            return fail(task, MEMORY_CAP_REACHED);
+
+        switch (task->state) {
+            case FETCH_RESOLVE: {
+                struct sockaddr_storage address;
+                socklen_t address_length;
+
+                if (context->replay) {
+                    if (start_replay(task) < 0)
+                        return FETCH_FINISHED;
+                    break;
+                }
+
+                ret = resolve_node(&context->dns_cache, task->host_id, host_table_name(context->hosts, task->host_id),
+                    task->port, &address, &address_length);
+
+                //The lookup counts towards the connect timeout
+                if (ret == CONNECTION_WANT_READ) {
+                    if (task->timeout_at == 0)
+                        task->timeout_at = timeout_after(context->connect_timeout);
+                    return POLLIN;
+                }
+                if (ret == CONNECTION_NO_MEMORY)
+                    return fail(task, MEMORY_CAP_REACHED);
+                if (ret == -1)
+                    return fail(task, "unable to resolve host");
+
+                ret = start_connection(&task->connection, (struct sockaddr *) &address, address_length);
+                if (ret == -1)
+                    return fail(task, "unable to connect");
+
+                //A pending lookup already started the timeout, resolving and connecting share it
+                task->state = FETCH_CONNECT;
+                if (task->timeout_at == 0)
+                    task->timeout_at = timeout_after(context->connect_timeout);
+
+                if (ret == CONNECTION_WANT_WRITE)
+                    return POLLOUT;
+                break;
+            }
+            case FETCH_CONNECT:
+                if (finish_connection(&task->connection) < 0)
+                    return fail(task, "unable to connect");
+
+                if (!task->is_https) {
+                    task->state = FETCH_SEND;
+                    task->timeout_at = 0;
+                    break;
+                }
+
+                task->state = FETCH_HANDSHAKE;
+                task->timeout_at = timeout_after(context->tls_timeout);
+
+                ret = start_ssl_connection(&task->connection, context->ssl_ctx, host_table_name(context->hosts, task->host_id));
+                if (ret == -1)
+                    return fail(task, "ssl handshake failed");
+                if (ret != 0)
+                    return wait_for(ret);
+
+                task->state = FETCH_SEND;
+                task->timeout_at = 0;
+                break;
+            case FETCH_HANDSHAKE:
+                ret = continue_ssl_handshake(&task->connection);
+                if (ret == -1)
+                    return fail(task, "ssl handshake failed");
+                if (ret != 0)
+                    return wait_for(ret);
+
+                task->state = FETCH_SEND;
+                task->timeout_at = 0;
+                break;
+            case FETCH_SEND:
+                while (task->request_sent < task->request.used_size) {
+                    bytes = connection_write(&task->connection, &task->request.data[task->request_sent],
+                        task->request.used_size - task->request_sent);
+
+                    if (bytes == -1) //TODO: check if request is retryable and if so, do so
+                        return fail(task, "sending the request failed");
+                    if (bytes < 0)
+                        return wait_for_transfer(task, (int) bytes);
+
+                    task->request_sent += (size_t) bytes;
+                    task->timeout_at = 0;
+                }
+
+                task->state = FETCH_RECEIVE_HEADERS;
+                break;
+            case FETCH_RECEIVE_HEADERS:
+                bytes = receive(task);
+
+                if (bytes == 0)
+                    return fail(task, "connection closed before the headers were received");
+                if (bytes == -1)
+                    return fail(task, "receiving the response failed");
+                if (bytes < 0)
+                    return wait_for_transfer(task, (int) bytes);
+
+                ret = receive_headers(task, (size_t) bytes);
+                if (ret == -1)
+                    return fail(task, "invalid response headers");
+                if (ret == 0)
+                    break;
+
+                if (task->status_code >= 300 && task->status_code < 400) {
+                    //Location has already been reported, the body is not of interest
+                    task->state = FETCH_DONE;
+                    close_connection(&task->connection);
+                    return FETCH_FINISHED;
+                }
+
+                if (task->status_code < 200 || task->status_code >= 300) {
+                    sprintf(task->error_buffer, "server responded with status %d", task->status_code);
+                    return fail(task, task->error_buffer);
+                }
+
+                task->state = FETCH_PARSE;
+                break;
+            case FETCH_RECEIVE_BODY:
+                bytes = receive(task);
+
+                if (bytes == -1)
+                    return fail(task, "receiving the response failed");
+                if (bytes < 0)
+                    return wait_for_transfer(task, (int) bytes);
+
+                if (bytes == 0)
+                    task->body_complete = 1;
+                else
+                    decode_body(task, task->read_buffer, (size_t) bytes);
+
+                task->state = FETCH_PARSE;
+                break;
+            case FETCH_PARSE:
+                task->body_size += task->body.used_size;
+
+                if (task->is_html && html_parse_chunk(&task->parser, task->body.data, task->body.used_size) < 0)
+                    task->out_of_memory = 1;
+                text_buffer_reset(&task->body);
+
+                if (task->body_complete) {
+                    if (task->is_html)
+                        html_parser_finish(&task->parser);
+
+                    //The owner may have run out of memory while handling the last text
+                    if (task->out_of_memory)
+                        return fail(task, MEMORY_CAP_REACHED);
+
+                    task->state = FETCH_DONE;
+                    close_connection(&task->connection);
+                    return FETCH_FINISHED;
+                }
+
+                //Give the other tasks a chance to run before receiving the next chunk
+                task->state = FETCH_RECEIVE_BODY;
+                return FETCH_YIELD;
+            case FETCH_DONE:
+            case FETCH_FAILED:
+                return FETCH_FINISHED;
+        }
+    }
+}
+
+void fetch_task_free(FetchTask *task)
+{
+    if (!task)
+        return;
+
+    close_connection(&task->connection);
+    replay_stream_close(&task->replay);
+
+    html_parser_free(&task->parser);
+
+    text_buffer_free(&task->url);
+    text_buffer_free(&task->request);
+    text_buffer_free(&task->headers);
+    text_buffer_free(&task->body);
+    text_buffer_free(&task->link);
+    text_buffer_free(&task->text);
+    text_buffer_free(&task->captured);
+    mem_free(task);
+}
@@ -0,0 +1,106 @@
+#ifndef LIBFETCH
+#define LIBFETCH
+
+#include <poll.h>
+
+#include "connection.h"
+#include "parser.h"
+#include "replay.h"
+#include "url.h"
+
+#define FETCH_BUFFER_SIZE 2048
+
+/* Return values of fetch_task_step besides the poll events the task waits for. */
+#define FETCH_YIELD 0
+#define FETCH_FINISHED -1
+
+typedef enum FetchState {
+    FETCH_RESOLVE,
+    FETCH_CONNECT,
+    FETCH_HANDSHAKE,
+    FETCH_SEND,
+    FETCH_RECEIVE_HEADERS,
+    FETCH_RECEIVE_BODY,
+    FETCH_PARSE,
+    FETCH_DONE,
+    FETCH_FAILED
+} FetchState;
+
+typedef enum ChunkState {
+    CHUNK_SIZE,
+    CHUNK_EXTENSION,
+    CHUNK_DATA,
+    CHUNK_DATA_END,
+    CHUNK_TRAILER
+} ChunkState;
+
+struct FetchTask;
+
+/* State shared by all fetch tasks, the callbacks report the results of a task to its owner. */
+typedef struct FetchContext {
+    SSL_CTX *ssl_ctx;
+    DnsCache dns_cache;
+    HostTable *hosts;
+    u_int32_t connect_timeout;      /* timeouts in milliseconds, 0 disables the timeout */
+    u_int32_t tls_timeout;
+    u_int32_t read_timeout;
+    u_int64_t bytes_received;
+    Capture *capture;               /* if set, the responses are recorded in the capture */
+    Replay *replay;                 /* if set, the responses are served from the replay instead of the network */
+    void (*on_text)(void *owner, struct FetchTask *task, const char *text, size_t length);
+    void (*on_link)(void *owner, struct FetchTask *task, const char *url, size_t length, u_int8_t is_redirect);
+    void *owner;
+} FetchContext;
+
+/* Fetching and parsing a single page, split into states so the task can be suspended whenever it would block. */
+typedef struct FetchTask {
+    FetchState state;
+    FetchContext *context;
+
+    TextBuffer url;
+    UrlComponents components;
+    u_int32_t host_id;
+    u_int32_t depth;
+    u_int16_t port;
+    u_int8_t is_https;
+
+    Connection connection;
+    ReplayStream replay;
+    u_int64_t timeout_at;           /* monotonic time in milliseconds, 0 if the task waits without a timeout */
+    TextBuffer request;
+    size_t request_sent;
+
+    TextBuffer headers;
+    int status_code;
+    u_int8_t is_html;
+    u_int8_t is_chunked;
+    u_int8_t body_complete;
+    long long content_remaining;    /* -1 if the server did not send a content length */
+    ChunkState chunk_state;
+    u_int64_t chunk_remaining;
+    u_int32_t trailer_line_length;
+
+    char read_buffer[FETCH_BUFFER_SIZE];
+    TextBuffer body;                /* decoded body data that has not been parsed yet */
+    size_t body_size;
+    HtmlParser parser;
+    TextBuffer link;
+    TextBuffer text;                /* output of the page that is held back by the owner of the task */
+    TextBuffer captured;            /* everything received so far, only filled while capturing */
+
+    u_int8_t out_of_memory;         /* set if an allocation of the task or its owner failed because of the memory cap */
+    const char *error;
+    char error_buffer[64];
+} FetchTask;
+
+FetchTask *fetch_task_create(FetchContext *context, const char *url, size_t length, u_int32_t depth);
+
+short fetch_task_step(FetchTask *task);
+
+int fetch_task_fd(const FetchTask *task);
+
+void fetch_task_timeout(FetchTask *task);
+
+void fetch_task_free(FetchTask *task);
+
+#endif
\ No newline at end of file
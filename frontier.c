@@ -0,0 +1,371 @@
+#include <unistd.h>
+
+#include "frontier.h"
+
+#define FRONTIER_INITIAL_CAPACITY 64
+#define SEEN_INITIAL_CAPACITY 256
+/* Number of spilled urls that are read back into memory at once */
+#define SPILL_REFILL_COUNT 256
+
+
+/**
+ * @brief Create an empty frontier.
+ *
+ * @return Frontier* the frontier, has to be freed with frontier_free
+ */
+Frontier *frontier_create(void)
+{
+    Frontier *frontier = mem_alloc(MEMORY_FRONTIER, sizeof(Frontier));
+    if (!frontier)
+        error_exit("malloc failed when creating frontier");
+
+    frontier->entries = mem_alloc(MEMORY_FRONTIER, FRONTIER_INITIAL_CAPACITY * sizeof(FrontierEntry));
+    frontier->capacity = FRONTIER_INITIAL_CAPACITY;
+    frontier->head = 0;
+    frontier->count = 0;
+    frontier->seen = mem_calloc(MEMORY_SEEN, SEEN_INITIAL_CAPACITY, sizeof(u_int64_t));
+    frontier->seen_capacity = SEEN_INITIAL_CAPACITY;
+    frontier->seen_count = 0;
+    frontier->spill = NULL;
+    frontier->spill_offset = 0;
+    frontier->spilled_count = 0;
+    frontier->spilled_total = 0;
+    frontier->refill_count = SPILL_REFILL_COUNT;
+
+    if (!frontier->entries || !frontier->seen)
+        error_exit("malloc failed when creating frontier");
+
+    return frontier;
+}
+
+static u_int64_t fingerprint(const char *url, size_t length)
+{
+    //64 bit FNV-1a, a collision only means that a single url is not crawled
+    u_int64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) url[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash ? hash : 1;
+}
+
+static int seen_insert(u_int64_t *seen, u_int32_t capacity, u_int64_t hash)
+{
+    u_int32_t slot = (u_int32_t) hash & (capacity - 1);
+
+    while (seen[slot] != 0) {
+        if (seen[slot] == hash)
+            return 0;
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    seen[slot] = hash;
+    return 1;
+}
+
+static int seen_contains(const Frontier *frontier, u_int64_t hash)
+{
+    u_int32_t slot = (u_int32_t) hash & (frontier->seen_capacity - 1);
+
+    while (frontier->seen[slot] != 0) {
+        if (frontier->seen[slot] == hash)
+            return 1;
+        slot = (slot + 1) & (frontier->seen_capacity - 1);
+    }
+    return 0;
+}
+
+static int seen_grow(Frontier *frontier)
+{
+    u_int32_t capacity = frontier->seen_capacity * 2;
+    u_int64_t *seen = mem_calloc(MEMORY_SEEN, capacity, sizeof(u_int64_t));
+    if (!seen)
+        return 0;
+
+    for (u_int32_t i = 0; i < frontier->seen_capacity; ++i) {
+        if (frontier->seen[i] != 0)
+            seen_insert(seen, capacity, frontier->seen[i]);
+    }
+
+    mem_free(frontier->seen);
+    frontier->seen = seen;
+    frontier->seen_capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief Make sure that one more url fits into the seen set. The load factor is kept at or
+ *  below 1/2, if the memory cap does not allow for a bigger table, the current one is filled
+ *  up to 7/8.
+ *
+ * @return int 1 if there is room, 0 if the seen set is full
+ */
+static int seen_has_room(Frontier *frontier)
+{
+    return frontier->seen_count + 1 < frontier->seen_capacity / 2 || seen_grow(frontier)
+        || frontier->seen_count + 1 < frontier->seen_capacity - frontier->seen_capacity / 8;
+}
+
+static int entries_grow(Frontier *frontier)
+{
+    u_int32_t capacity = frontier->capacity * 2;
+
+    FrontierEntry *entries = mem_realloc(MEMORY_FRONTIER, frontier->entries, capacity * sizeof(FrontierEntry));
+    if (!entries)
+        return 0;
+    frontier->entries = entries;
+
+    //Move the wrapped around part behind the old end, so the queue is contiguous again
+    if (frontier->head + frontier->count > frontier->capacity) {
+        u_int32_t wrapped = frontier->head + frontier->count - frontier->capacity;
+        memcpy(&frontier->entries[frontier->capacity], frontier->entries, wrapped * sizeof(FrontierEntry));
+    }
+
+    frontier->capacity = capacity;
+    return 1;
+}
+
+static int open_spill(Frontier *frontier)
+{
+    if (!frontier->spill)
+        frontier->spill = tmpfile();
+
+    return frontier->spill != NULL;
+}
+
+static void spill_write(Frontier *frontier, const char *url, size_t length, u_int32_t depth)
+{
+    u_int32_t header[2] = { depth, (u_int32_t) length };
+
+    if (fseek(frontier->spill, 0, SEEK_END) == -1
+        || fwrite(header, sizeof(header), 1, frontier->spill) != 1
+        || fwrite(url, sizeof(char), length, frontier->spill) != length)
+        error_exit("writing to the frontier spill file failed");
+
+    frontier->spilled_count++;
+    frontier->spilled_total++;
+}
+
+/**
+ * @brief Read spilled urls back into memory, the spill file is truncated once it is empty.
+ *  Stops early if the memory cap does not allow for more urls.
+ */
+static void spill_refill(Frontier *frontier)
+{
+    if (fseek(frontier->spill, frontier->spill_offset, SEEK_SET) == -1)
+        error_exit("reading the frontier spill file failed");
+
+    for (u_int32_t i = 0; i < frontier->refill_count && frontier->spilled_count > 0; ++i) {
+        u_int32_t header[2];
+        long offset = ftell(frontier->spill);
+
+        if (frontier->count == frontier->capacity && !entries_grow(frontier))
+            break;
+
+        if (fread(header, sizeof(header), 1, frontier->spill) != 1)
+            error_exit("reading the frontier spill file failed");
+
+        char *url = mem_alloc(MEMORY_FRONTIER, (header[1] + 1) * sizeof(char));
+        if (!url) {
+            //The url stays in the spill file
+            if (fseek(frontier->spill, offset, SEEK_SET) == -1)
+                error_exit("reading the frontier spill file failed");
+            break;
+        }
+
+        if (fread(url, sizeof(char), header[1], frontier->spill) != header[1])
+            error_exit("reading the frontier spill file failed");
+        url[header[1]] = '\0';
+
+        FrontierEntry *entry = &frontier->entries[(frontier->head + frontier->count) % frontier->capacity];
+        entry->url = url;
+        entry->depth = header[0];
+        frontier->count++;
+        frontier->spilled_count--;
+    }
+
+    frontier->spill_offset = ftell(frontier->spill);
+
+    if (frontier->spilled_count == 0) {
+        if (ftruncate(fileno(frontier->spill), 0) == -1)
+            error_exit("truncating the frontier spill file failed");
+        rewind(frontier->spill);
+        frontier->spill_offset = 0;
+        frontier->refill_count = SPILL_REFILL_COUNT;
+    }
+}
+
+/**
+ * @brief Queue the url, unless it has been queued before.
+ *
+ * @param frontier frontier
+ * @param url normalized url, does not have to be null terminated
+ * @param length length of the url
+ * @param depth number of links that were followed to find the url
+ * @return int 1 if the url was queued, 0 if it has been seen before, -1 if the frontier is
+ *  full or the memory cap has been reached and no spill file can be created (the url is not
+ *  marked as seen in that case)
+ */
+int frontier_push(Frontier *frontier, const char *url, size_t length, u_int32_t depth)
+{
+    u_int64_t hash = fingerprint(url, length);
+
+    if (seen_contains(frontier, hash))
+        return 0;
+
+    if (!seen_has_room(frontier))
+        return -1;
+
+    char *copy = NULL;
+
+    //Once urls have been spilled, new urls go to the spill file as well to keep the order.
+    //Urls that do not fit into memory because of the memory cap are spilled too.
+    if (frontier->spilled_count == 0 && frontier->count < FRONTIER_LIMIT
+        && (frontier->count < frontier->capacity || entries_grow(frontier)))
+        copy = mem_alloc(MEMORY_FRONTIER, (length + 1) * sizeof(char));
+
+    if (!copy && !open_spill(frontier))
+        return -1;
+
+    seen_insert(frontier->seen, frontier->seen_capacity, hash);
+    frontier->seen_count++;
+
+    if (!copy) {
+        spill_write(frontier, url, length, depth);
+        return 1;
+    }
+
+    memcpy(copy, url, length);
+    copy[length] = '\0';
+
+    FrontierEntry *entry = &frontier->entries[(frontier->head + frontier->count) % frontier->capacity];
+    entry->url = copy;
+    entry->depth = depth;
+    frontier->count++;
+
+    return 1;
+}
+
+/**
+ * @brief Take the oldest url out of the frontier.
+ *
+ * @param frontier frontier
+ * @param entry filled with the url and its depth, the url has to be freed by the caller
+ * @return int 1 if an url was taken, 0 if the frontier is empty
+ */
+int frontier_pop(Frontier *frontier, FrontierEntry *entry)
+{
+    if (frontier->count == 0 && frontier->spilled_count > 0)
+        spill_refill(frontier);
+
+    if (frontier->count == 0)
+        return 0;
+
+    *entry = frontier->entries[frontier->head];
+    frontier->head = (frontier->head + 1) % frontier->capacity;
+    frontier->count--;
+
+    return 1;
+}
+
+/**
+ * @brief Get the number of queued urls, including the spilled ones.
+ */
+u_int32_t frontier_size(const Frontier *frontier)
+{
+    return frontier->count + frontier->spilled_count;
+}
+
+/**
+ * @brief Mark the url as seen without queuing it, so later pushes of the url are ignored.
+ *
+ * @param frontier frontier
+ * @param url normalized url, does not have to be null terminated
+ * @param length length of the url
+ * @return int 1 if the url has been marked, 0 if it has been seen before, -1 if the seen set
+ *  is full because of the memory cap
+ */
+int frontier_mark_seen(Frontier *frontier, const char *url, size_t length)
+{
+    u_int64_t hash = fingerprint(url, length);
+
+    if (seen_contains(frontier, hash))
+        return 0;
+
+    if (!seen_has_room(frontier))
+        return -1;
+
+    seen_insert(frontier->seen, frontier->seen_capacity, hash);
+    frontier->seen_count++;
+    return 1;
+}
+
+/**
+ * @brief Move all but the oldest urls to the spill file and release their memory. Used to
+ *  reduce the memory usage when the memory cap is close. Until the spill file is empty, only
+ *  as many urls as are kept are read back at once, so they are not spilled again right away.
+ *
+ * @param frontier frontier
+ * @param keep number of urls that stay in memory
+ * @return u_int32_t number of spilled urls
+ */
+u_int32_t frontier_spill(Frontier *frontier, u_int32_t keep)
+{
+    if (frontier->count <= keep || !open_spill(frontier))
+        return 0;
+
+    u_int32_t spilled = frontier->count - keep;
+
+    //The newest urls are moved, they are fetched after the urls that were spilled before
+    for (u_int32_t i = keep; i < frontier->count; ++i) {
+        FrontierEntry *entry = &frontier->entries[(frontier->head + i) % frontier->capacity];
+
+        spill_write(frontier, entry->url, strlen(entry->url), entry->depth);
+        mem_free(entry->url);
+    }
+    frontier->count = keep;
+    frontier->refill_count = keep > 0 ? keep : 1;
+
+    //Shrink the ring buffer, the remaining entries are moved to the start
+    u_int32_t capacity = FRONTIER_INITIAL_CAPACITY;
+    while (capacity < keep)
+        capacity *= 2;
+
+    //If the smaller ring buffer can not be allocated, the bigger one is kept
+    FrontierEntry *entries = capacity < frontier->capacity
+        ? mem_alloc(MEMORY_FRONTIER, capacity * sizeof(FrontierEntry)) : NULL;
+
+    if (entries) {
+        for (u_int32_t i = 0; i < frontier->count; ++i)
+            entries[i] = frontier->entries[(frontier->head + i) % frontier->capacity];
+
+        mem_free(frontier->entries);
+        frontier->entries = entries;
+        frontier->capacity = capacity;
+        frontier->head = 0;
+    }
+
+    return spilled;
+}
+
+void frontier_free(Frontier *frontier)
+{
+    if (!frontier)
+        return;
+
+    //Spilled urls only live in the spill file
+    frontier->spilled_count = 0;
+
+    FrontierEntry entry;
+    while (frontier_pop(frontier, &entry))
+        mem_free(entry.url);
+
+    if (frontier->spill)
+        fclose(frontier->spill);
+
+    mem_free(frontier->entries);
+    mem_free(frontier->seen);
+    mem_free(frontier);
+}
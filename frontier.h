@@ -0,0 +1,47 @@
+#ifndef LIBFRONTIER
+#define LIBFRONTIER
+
+#include <sys/types.h>
+
+#include "utilities.h"
+
+/* Upper bound for the number of urls kept in memory, further urls are spilled to a temporary file. */
+#define FRONTIER_LIMIT 100000
+
+typedef struct FrontierEntry {
+    char *url;
+    u_int32_t depth;
+} FrontierEntry;
+
+/* FIFO queue of urls that still have to be fetched, together with the set of all urls that were ever queued.
+   Urls that are spilled to disk are fetched after all urls in memory. */
+typedef struct Frontier {
+    FrontierEntry *entries;     /* ring buffer */
+    u_int32_t capacity;
+    u_int32_t head;
+    u_int32_t count;
+    FILE *spill;                /* created on first use, read from spill_offset, written at the end */
+    long spill_offset;
+    u_int32_t spilled_count;
+    u_int64_t spilled_total;
+    u_int32_t refill_count;     /* number of spilled urls read back at once */
+    u_int64_t *seen;            /* open addressing set of url fingerprints, 0 marks an empty slot */
+    u_int32_t seen_capacity;
+    u_int32_t seen_count;
+} Frontier;
+
+Frontier *frontier_create(void);
+
+int frontier_push(Frontier *frontier, const char *url, size_t length, u_int32_t depth);
+
+int frontier_pop(Frontier *frontier, FrontierEntry *entry);
+
+u_int32_t frontier_size(const Frontier *frontier);
+
+int frontier_mark_seen(Frontier *frontier, const char *url, size_t length);
+
+u_int32_t frontier_spill(Frontier *frontier, u_int32_t keep);
+
+void frontier_free(Frontier *frontier);
+
+#endif
\ No newline at end of file
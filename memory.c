@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+/* Every allocation is prefixed with its size and subsystem, so it can be accounted on free. */
+typedef union MemoryHeader {
+    struct {
+        size_t size;
+        u_int32_t subsystem;
+    } info;
+    long double align_long_double;
+    long long align_long_long;
+    void *align_pointer;
+} MemoryHeader;
+
+static const char *subsystem_names[MEMORY_SUBSYSTEM_COUNT] = {
+    "text buffers",
+    "frontier",
+    "seen set",
+    "dns cache",
+    "host table",
+    "connections",
+    "output batches",
+    "capture / replay",
+    "other"
+};
+
+static size_t current_usage[MEMORY_SUBSYSTEM_COUNT];
+static size_t peak_usage[MEMORY_SUBSYSTEM_COUNT];
+static u_int64_t allocations[MEMORY_SUBSYSTEM_COUNT];
+
+static size_t total_usage = 0;
+static size_t total_peak = 0;
+static size_t usage_limit = 0;
+
+
+static void account(u_int32_t subsystem, size_t old_size, size_t new_size)
+{
+    current_usage[subsystem] = current_usage[subsystem] - old_size + new_size;
+    total_usage = total_usage - old_size + new_size;
+
+    if (current_usage[subsystem] > peak_usage[subsystem])
+        peak_usage[subsystem] = current_usage[subsystem];
+
+    if (total_usage > total_peak)
+        total_peak = total_usage;
+}
+
+static int exceeds_limit(size_t additional_size)
+{
+    return usage_limit && (additional_size > usage_limit || total_usage > usage_limit - additional_size);
+}
+
+/**
+ * @brief Allocate memory that is accounted to the given subsystem. Fails like malloc if the
+ *  allocation would exceed the memory cap.
+ *
+ * @param subsystem subsystem the memory belongs to
+ * @param size size of the allocation
+ * @return void* the allocated memory, NULL if the allocation failed (errno is set)
+ */
+void *mem_alloc(MemorySubsystem subsystem, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(MemoryHeader) || exceeds_limit(size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    MemoryHeader *header = malloc(sizeof(MemoryHeader) + size);
+    if (!header)
+        return NULL;
+
+    header->info.size = size;
+    header->info.subsystem = subsystem;
+
+    account(subsystem, 0, size);
+    allocations[subsystem]++;
+
+    return header + 1;
+}
+
+/**
+ * @brief See mem_alloc, the memory is zeroed.
+ */
+void *mem_calloc(MemorySubsystem subsystem, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *ptr = mem_alloc(subsystem, count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+
+    return ptr;
+}
+
+/**
+ * @brief Resize memory allocated by mem_alloc. Like realloc, the original memory stays
+ *  valid if the reallocation fails.
+ *
+ * @param subsystem subsystem the memory belongs to, only used if ptr is NULL
+ * @param ptr memory to be resized, may be NULL
+ * @param size new size
+ * @return void* the resized memory, NULL if the reallocation failed (errno is set)
+ */
+void *mem_realloc(MemorySubsystem subsystem, void *ptr, size_t size)
+{
+    if (!ptr)
+        return mem_alloc(subsystem, size);
+
+    MemoryHeader *header = (MemoryHeader *) ptr - 1;
+    size_t old_size = header->info.size;
+
+    if (size > SIZE_MAX - sizeof(MemoryHeader) || (size > old_size && exceeds_limit(size - old_size))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    header = realloc(header, sizeof(MemoryHeader) + size);
+    if (!header)
+        return NULL;
+
+    header->info.size = size;
+
+    account(header->info.subsystem, old_size, size);
+    allocations[header->info.subsystem]++;
+
+    return header + 1;
+}
+
+/**
+ * @brief Free memory allocated by mem_alloc, mem_calloc or mem_realloc.
+ *
+ * @param ptr memory to be freed, may be NULL
+ */
+void mem_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    MemoryHeader *header = (MemoryHeader *) ptr - 1;
+
+    account(header->info.subsystem, header->info.size, 0);
+    free(header);
+}
+
+/**
+ * @brief Set the memory cap, allocations that would exceed it fail.
+ *
+ * @param limit cap in bytes, 0 disables the cap
+ */
+void memory_set_limit(size_t limit)
+{
+    usage_limit = limit;
+}
+
+size_t memory_limit(void)
+{
+    return usage_limit;
+}
+
+size_t memory_usage(MemorySubsystem subsystem)
+{
+    return current_usage[subsystem];
+}
+
+size_t memory_total(void)
+{
+    return total_usage;
+}
+
+/**
+ * @brief Get the number of allocations (including reallocations) made so far.
+ */
+u_int64_t memory_allocation_count(void)
+{
+    u_int64_t count = 0;
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i)
+        count += allocations[i];
+
+    return count;
+}
+
+/**
+ * @brief Check whether the memory usage is close enough to the cap that caches should be
+ *  evicted.
+ *
+ * @return int 1 if the soft limit is exceeded, 0 otherwise or if there is no cap
+ */
+int memory_over_soft_limit(void)
+{
+    return usage_limit && total_usage > usage_limit / 100 * MEMORY_SOFT_LIMIT_PERCENT;
+}
+
+/**
+ * @brief Check whether the memory usage has dropped far enough below the cap that the memory
+ *  pressure is over.
+ *
+ * @return int 1 if the usage is below the low water mark or there is no cap, 0 otherwise
+ */
+int memory_below_low_water(void)
+{
+    return !usage_limit || total_usage < usage_limit / 100 * MEMORY_LOW_WATER_PERCENT;
+}
+
+/**
+ * @brief Check whether a subsystem holds enough of the memory cap to be worth evicting.
+ *
+ * @param subsystem subsystem
+ * @return int 1 if the subsystem holds at least MEMORY_EVICT_SHARE_PERCENT of the cap, 0 otherwise
+ *  or if there is no cap
+ */
+int memory_holds_share(MemorySubsystem subsystem)
+{
+    return usage_limit && current_usage[subsystem] >= usage_limit / 100 * MEMORY_EVICT_SHARE_PERCENT;
+}
+
+/**
+ * @brief Get the number of bytes that can still be allocated before the memory cap is reached.
+ *
+ * @return size_t remaining bytes, SIZE_MAX if there is no cap
+ */
+size_t memory_headroom(void)
+{
+    if (!usage_limit)
+        return SIZE_MAX;
+
+    return total_usage < usage_limit ? usage_limit - total_usage : 0;
+}
+
+/**
+ * @brief Print current and peak usage and the number of allocations of every subsystem.
+ *
+ * @param stream stream the statistics are printed to
+ */
+void memory_print_stats(FILE *stream)
+{
+    fprintf(stream, "Memory: %zu bytes (peak %zu", total_usage, total_peak);
+    if (usage_limit)
+        fprintf(stream, ", cap %zu", usage_limit);
+    fprintf(stream, ")\n");
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+        fprintf(stream, "\t%-16s %10zu bytes (peak %zu, %llu allocations)\n", subsystem_names[i],
+            current_usage[i], peak_usage[i], (unsigned long long) allocations[i]);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef LIBMEMORY
+#define LIBMEMORY
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Above this share of the memory cap the crawler starts evicting caches and spilling the frontier. */
+#define MEMORY_SOFT_LIMIT_PERCENT 75
+/* Below this share of the memory cap the memory pressure is over. */
+#define MEMORY_LOW_WATER_PERCENT 60
+/* Caches and queues holding less than this share of the memory cap are not worth evicting. */
+#define MEMORY_EVICT_SHARE_PERCENT 10
+
+/* Error of a page that failed because an allocation would have exceeded the memory cap */
+#define MEMORY_CAP_REACHED "memory cap reached"
+
+typedef enum MemorySubsystem {
+    MEMORY_TEXT,
+    MEMORY_FRONTIER,
+    MEMORY_SEEN,
+    MEMORY_DNS,
+    MEMORY_HOSTS,
+    MEMORY_CONNECTION,
+    MEMORY_OUTPUT,
+    MEMORY_REPLAY,
+    MEMORY_OTHER,
+    MEMORY_SUBSYSTEM_COUNT
+} MemorySubsystem;
+
+void *mem_alloc(MemorySubsystem subsystem, size_t size);
+
+void *mem_calloc(MemorySubsystem subsystem, size_t count, size_t size);
+
+void *mem_realloc(MemorySubsystem subsystem, void *ptr, size_t size);
+
+void mem_free(void *ptr);
+
+void memory_set_limit(size_t limit);
+
+size_t memory_limit(void);
+
+size_t memory_usage(MemorySubsystem subsystem);
+
+size_t memory_total(void);
+
+u_int64_t memory_allocation_count(void);
+
+int memory_over_soft_limit(void);
+
+int memory_below_low_water(void);
+
+int memory_holds_share(MemorySubsystem subsystem);
+
+size_t memory_headroom(void);
+
+void memory_print_stats(FILE *stream);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include <unistd.h>
+
+#include "output.h"
+
+#define OUTPUT_BUFFER_SIZE 4096
+
+
+/**
+ * @brief Initialize the writer.
+ *
+ * @param writer writer to be initialized
+ * @param fd file descriptor the output is written to
+ */
+void output_init(OutputWriter *writer, int fd)
+{
+    writer->fd = fd;
+    writer->batch.data = NULL;
+    writer->batch.available_size = 0;
+    writer->batch.used_size = 0;
+    writer->batch.subsystem = MEMORY_OUTPUT;
+    writer->written = 0;
+
+    if (text_buffer_reserve(&writer->batch, OUTPUT_BUFFER_SIZE - 1) < 0)
+        error_exit("realloc failed when creating output batch");
+    text_buffer_reset(&writer->batch);
+}
+
+static void write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t bytes = write(fd, data, length);
+        if (bytes == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            error_exit("write failed when writing output");
+        }
+
+        data += bytes;
+        length -= (size_t) bytes;
+    }
+}
+
+/**
+ * @brief Add data to the current batch, nothing is written yet. If the batch can not grow
+ *  because of the memory cap, the batch and the data are written right away instead.
+ *
+ * @param writer writer
+ * @param data data to be written
+ * @param length length of the data
+ */
+void output_write(OutputWriter *writer, const char *data, size_t length)
+{
+    //Drop the part that has already been written before the batch has to grow
+    if (writer->written > 0 && writer->batch.used_size + length >= writer->batch.available_size) {
+        memmove(writer->batch.data, &writer->batch.data[writer->written], writer->batch.used_size - writer->written);
+        writer->batch.used_size -= writer->written;
+        writer->written = 0;
+    }
+
+    if (text_buffer_append(&writer->batch, data, length) < 0) {
+        output_flush(writer);
+        write_all(writer->fd, data, length);
+    }
+}
+
+/**
+ * @brief Get the number of bytes that are waiting to be written.
+ */
+size_t output_pending(const OutputWriter *writer)
+{
+    return writer->batch.used_size - writer->written;
+}
+
+static void write_pending(OutputWriter *writer, size_t limit)
+{
+    size_t length = output_pending(writer);
+    if (length > limit)
+        length = limit;
+
+    ssize_t bytes = write(writer->fd, &writer->batch.data[writer->written], length);
+    if (bytes == -1) {
+        if (errno == EINTR || errno == EAGAIN)
+            return;
+        error_exit("write failed when writing output");
+    }
+
+    writer->written += (size_t) bytes;
+
+    if (writer->written == writer->batch.used_size) {
+        writer->batch.used_size = 0;
+        writer->written = 0;
+    }
+}
+
+/**
+ * @brief Write the next part of the batch once poll reported the file descriptor as writable.
+ *  At most PIPE_BUF bytes are written, so the write does not block even if the output is a
+ *  pipe whose reader falls behind.
+ *
+ * @param writer writer
+ */
+void output_flush_ready(OutputWriter *writer)
+{
+    if (output_pending(writer) > 0)
+        write_pending(writer, PIPE_BUF);
+}
+
+/**
+ * @brief Write everything that is pending, blocking if necessary.
+ *
+ * @param writer writer
+ */
+void output_flush(OutputWriter *writer)
+{
+    while (output_pending(writer) > 0)
+        write_pending(writer, output_pending(writer));
+}
+
+/**
+ * @brief Release the memory of a batch that has grown while the output fell behind. Only
+ *  has an effect if nothing is pending.
+ *
+ * @param writer writer
+ */
+void output_shrink(OutputWriter *writer)
+{
+    if (output_pending(writer) > 0 || writer->batch.available_size <= OUTPUT_BUFFER_SIZE)
+        return;
+
+    //If the memory cap does not even allow for the small batch, it is allocated on the next write
+    text_buffer_free(&writer->batch);
+    text_buffer_reserve(&writer->batch, OUTPUT_BUFFER_SIZE - 1);
+    text_buffer_reset(&writer->batch);
+}
+
+void output_free(OutputWriter *writer)
+{
+    text_buffer_free(&writer->batch);
+}
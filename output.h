@@ -0,0 +1,27 @@
+#ifndef LIBOUTPUT
+#define LIBOUTPUT
+
+#include "utilities.h"
+
+/* Batches the output and writes it without ever blocking the crawl for long. */
+typedef struct OutputWriter {
+    int fd;
+    TextBuffer batch;
+    size_t written;     /* bytes at the start of the batch that have already been written */
+} OutputWriter;
+
+void output_init(OutputWriter *writer, int fd);
+
+void output_write(OutputWriter *writer, const char *data, size_t length);
+
+size_t output_pending(const OutputWriter *writer);
+
+void output_flush_ready(OutputWriter *writer);
+
+void output_flush(OutputWriter *writer);
+
+void output_shrink(OutputWriter *writer);
+
+void output_free(OutputWriter *writer);
+
+#endif
\ No newline at end of file
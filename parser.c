@@ -1,2 +1,312 @@
+#include <ctype.h>
 
-//email regex: ^[a-zA-Z0-9.!#$%&'*+/=?^_`{|}~-]+@[a-zA-Z0-9](?:[a-zA-Z0-9-]{0,61}[a-zA-Z0-9])?(?:\.[a-zA-Z0-9](?:[a-zA-Z0-9-]{0,61}[a-zA-Z0-9])?)*$
\ No newline at end of file
+#include "parser.h"
+
+//email regex: ^[a-zA-Z0-9.!#$%&'*+/=?^_`{|}~-]+@[a-zA-Z0-9](?:[a-zA-Z0-9-]{0,61}[a-zA-Z0-9])?(?:\.[a-zA-Z0-9](?:[a-zA-Z0-9-]{0,61}[a-zA-Z0-9])?)*$
+
+/* Text nodes longer than this are reported in several parts, so the buffer never grows beyond it. */
+#define TEXTBUFFER_SIZE 2048
+#define TAG_BUFFER_SIZE 256
+/* Tags longer than this (e.g. huge inline comments) are truncated, links in the cut part are lost. */
+#define TAG_BUFFER_LIMIT 8192
+
+
+/**
+ * @brief Initialize the parser.
+ *
+ * @param parser parser to be initialized
+ * @param on_text called with the text between two tags, whitespace is collapsed
+ * @param on_link called with the (unresolved) value of every href attribute of a, area and link tags,
+ *  character references like &amp; are decoded
+ * @param context passed to the callbacks
+ * @return int 0 on success, -1 if the memory cap has been reached
+ */
+int html_parser_init(HtmlParser *parser, TextCallback on_text, LinkCallback on_link, void *context)
+{
+    memset(parser, 0, sizeof(HtmlParser));
+
+    parser->on_text = on_text;
+    parser->on_link = on_link;
+    parser->context = context;
+
+    if (text_buffer_reserve(&parser->text, TEXTBUFFER_SIZE - 1) < 0
+        || text_buffer_reserve(&parser->tag, TAG_BUFFER_SIZE - 1) < 0)
+        return -1;
+
+    text_buffer_reset(&parser->text);
+    text_buffer_reset(&parser->tag);
+    return 0;
+}
+
+static int attribute_name_equals(const char *name, size_t length, const char *expected)
+{
+    if (strlen(expected) != length)
+        return 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        if (tolower((unsigned char) name[i]) != expected[i])
+            return 0;
+    }
+    return 1;
+}
+
+static size_t encode_utf8(unsigned long code_point, char *out)
+{
+    if (code_point < 0x80) {
+        out[0] = (char) code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char) (0xC0 | (code_point >> 6));
+        out[1] = (char) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char) (0xE0 | (code_point >> 12));
+        out[1] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code_point >> 18));
+    out[1] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief Decode the character reference at the start of the value (e.g. &amp; or &#38;).
+ *
+ * @param value value starting with '&'
+ * @param length length of the value
+ * @param out filled with the decoded character, at most 4 bytes
+ * @param decoded_length set to the number of bytes written to out
+ * @return size_t length of the reference, 0 if the value does not start with a known reference
+ */
+static size_t decode_reference(const char *value, size_t length, char *out, size_t *decoded_length)
+{
+    static const struct {
+        const char *name;
+        char character;
+    } named[] = { { "amp;", '&' }, { "lt;", '<' }, { "gt;", '>' }, { "quot;", '"' }, { "apos;", '\'' } };
+
+    if (length > 1 && value[1] == '#') {
+        size_t i = 2;
+        int base = 10;
+
+        if (i < length && (value[i] == 'x' || value[i] == 'X')) {
+            base = 16;
+            ++i;
+        }
+
+        unsigned long code_point = 0;
+        size_t digits_start = i;
+
+        while (i < length && (base == 16 ? isxdigit((unsigned char) value[i]) : isdigit((unsigned char) value[i]))) {
+            int digit = isdigit((unsigned char) value[i]) ? value[i] - '0' : tolower((unsigned char) value[i]) - 'a' + 10;
+            code_point = code_point * base + digit;
+            if (code_point > 0x10FFFF)
+                return 0;
+            ++i;
+        }
+
+        //Null and surrogates are not characters
+        if (i == digits_start || i >= length || value[i] != ';' || code_point == 0
+            || (code_point >= 0xD800 && code_point <= 0xDFFF))
+            return 0;
+
+        *decoded_length = encode_utf8(code_point, out);
+        return i + 1;
+    }
+
+    for (size_t i = 0; i < sizeof(named) / sizeof(named[0]); ++i) {
+        size_t name_length = strlen(named[i].name);
+
+        if (length > name_length && memcmp(&value[1], named[i].name, name_length) == 0) {
+            out[0] = named[i].character;
+            *decoded_length = 1;
+            return name_length + 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Decode the character references of an attribute value in place. A reference is never
+ *  shorter than the character it stands for, unknown references are kept as they are.
+ *
+ * @return size_t length of the decoded value
+ */
+static size_t decode_attribute_value(char *value, size_t length)
+{
+    size_t read = 0;
+    size_t written = 0;
+
+    while (read < length) {
+        char decoded[4];
+        size_t decoded_length;
+        size_t reference_length = value[read] == '&'
+            ? decode_reference(&value[read], length - read, decoded, &decoded_length) : 0;
+
+        if (reference_length == 0) {
+            value[written++] = value[read++];
+            continue;
+        }
+
+        memcpy(&value[written], decoded, decoded_length);
+        written += decoded_length;
+        read += reference_length;
+    }
+
+    return written;
+}
+
+/**
+ * @brief Look at a complete tag (without the enclosing '<' and '>') and report the
+ *  href attribute if the tag is a link.
+ */
+static void process_tag(HtmlParser *parser)
+{
+    char *tag = parser->tag.data;
+    size_t length = parser->tag.used_size;
+    size_t i = 0;
+
+    while (i < length && !isspace((unsigned char) tag[i]) && tag[i] != '/')
+        ++i;
+
+    if (!attribute_name_equals(tag, i, "a") && !attribute_name_equals(tag, i, "area")
+        && !attribute_name_equals(tag, i, "link"))
+        return;
+
+    while (i < length) {
+        while (i < length && (isspace((unsigned char) tag[i]) || tag[i] == '/'))
+            ++i;
+
+        size_t name_start = i;
+        while (i < length && !isspace((unsigned char) tag[i]) && tag[i] != '=' && tag[i] != '/')
+            ++i;
+        size_t name_length = i - name_start;
+
+        while (i < length && isspace((unsigned char) tag[i]))
+            ++i;
+
+        if (i >= length || tag[i] != '=') {
+            if (name_length == 0)
+                ++i;
+            continue;
+        }
+        ++i;
+
+        while (i < length && isspace((unsigned char) tag[i]))
+            ++i;
+
+        size_t value_start;
+        size_t value_length;
+
+        if (i < length && (tag[i] == '"' || tag[i] == '\'')) {
+            char quote = tag[i++];
+            value_start = i;
+            while (i < length && tag[i] != quote)
+                ++i;
+            value_length = i - value_start;
+            ++i;
+        } else {
+            value_start = i;
+            while (i < length && !isspace((unsigned char) tag[i]))
+                ++i;
+            value_length = i - value_start;
+        }
+
+        if (attribute_name_equals(&tag[name_start], name_length, "href")) {
+            if (parser->on_link)
+                parser->on_link(parser->context, &tag[value_start],
+                    decode_attribute_value(&tag[value_start], value_length));
+            return;
+        }
+    }
+}
+
+static void flush_text(HtmlParser *parser)
+{
+    if (parser->text.used_size > 0 && parser->on_text)
+        parser->on_text(parser->context, parser->text.data, parser->text.used_size);
+
+    parser->text.used_size = 0;
+    parser->text.data[0] = '\0';
+}
+
+/**
+ * @brief Feed the next chunk of the document to the parser. Text and links are reported
+ *  through the callbacks as soon as they are complete, tags and text that are cut off at
+ *  the end of the chunk are kept until the next chunk arrives. Long text is reported in
+ *  parts of at most TEXTBUFFER_SIZE - 1 characters.
+ *
+ * @param parser parser
+ * @param data next chunk of the document
+ * @param length length of the chunk
+ * @return int 0 on success, -1 if the tag buffer could not grow because of the memory cap
+ */
+int html_parse_chunk(HtmlParser *parser, const char *data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+
+        if (parser->inside_tag) {
+            if (c == '>') {
+                process_tag(parser);
+                parser->inside_tag = 0;
+            } else if (parser->tag.used_size < TAG_BUFFER_LIMIT) {
+                if (text_buffer_append(&parser->tag, &c, 1) < 0)
+                    return -1;
+            }
+            continue;
+        }
+
+        if (c == '<') {
+            flush_text(parser);
+
+            parser->inside_tag = 1;
+            parser->tag.used_size = 0;
+            parser->tag.data[0] = '\0';
+            continue;
+        }
+
+        if (c == 0xA || c == 0x20) { //LF and blank space
+            if (parser->previous_char_blank)
+                continue;
+            c = ' ';
+            parser->previous_char_blank = 1;
+        } else if (c == 0xD || c == 0x09) { //CR and tab
+            continue;
+        } else {
+            parser->previous_char_blank = 0;
+        }
+
+        //The buffer has room for TEXTBUFFER_SIZE - 1 characters and the terminating '\0'
+        if (parser->text.used_size >= TEXTBUFFER_SIZE - 1)
+            flush_text(parser);
+
+        parser->text.data[parser->text.used_size++] = c;
+    }
+
+    parser->text.data[parser->text.used_size] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Report the remaining text once the whole document has been parsed.
+ *
+ * @param parser parser
+ */
+void html_parser_finish(HtmlParser *parser)
+{
+    if (!parser->inside_tag)
+        flush_text(parser);
+}
+
+void html_parser_free(HtmlParser *parser)
+{
+    text_buffer_free(&parser->text);
+    text_buffer_free(&parser->tag);
+}
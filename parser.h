@@ -1,3 +1,29 @@
+#ifndef LIBPARSER
+#define LIBPARSER
 
+#include "utilities.h"
 
-int initiate_parsing(char *buffer);
\ No newline at end of file
+typedef void (*TextCallback)(void *context, const char *text, size_t length);
+
+typedef void (*LinkCallback)(void *context, const char *link, size_t length);
+
+/* Incremental HTML parser, the document can be fed in chunks of arbitrary size. */
+typedef struct HtmlParser {
+    TextBuffer text;
+    TextBuffer tag;
+    u_int8_t inside_tag;
+    u_int8_t previous_char_blank;
+    TextCallback on_text;
+    LinkCallback on_link;
+    void *context;
+} HtmlParser;
+
+int html_parser_init(HtmlParser *parser, TextCallback on_text, LinkCallback on_link, void *context);
+
+int html_parse_chunk(HtmlParser *parser, const char *data, size_t length);
+
+void html_parser_finish(HtmlParser *parser);
+
+void html_parser_free(HtmlParser *parser);
+
+#endif
\ No newline at end of file
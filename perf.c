@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "perf.h"
+
+
+static u_int64_t clock_ns(clockid_t clock)
+{
+    struct timespec now;
+
+    if (clock_gettime(clock, &now) == -1)
+        return 0;
+
+    return (u_int64_t) now.tv_sec * 1000000000 + (u_int64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Start measuring a crawl.
+ *
+ * @param timer filled with the current time, cpu time and allocation counter
+ */
+void perf_start(PerfTimer *timer)
+{
+    timer->start_ns = clock_ns(CLOCK_MONOTONIC);
+    timer->start_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    timer->start_allocations = memory_allocation_count();
+}
+
+/**
+ * @brief Stop measuring a crawl and compute its throughput.
+ *
+ * @param timer timer started with perf_start
+ * @param pages number of pages fetched since the timer was started
+ * @param report filled with the throughput
+ */
+void perf_stop(const PerfTimer *timer, u_int32_t pages, PerfReport *report)
+{
+    u_int64_t cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - timer->start_cpu_ns;
+    u_int64_t allocations = memory_allocation_count() - timer->start_allocations;
+    u_int32_t divisor = pages > 0 ? pages : 1;
+
+    report->pages = pages;
+    report->seconds = (double) (clock_ns(CLOCK_MONOTONIC) - timer->start_ns) / 1e9;
+    report->pages_per_second = report->seconds > 0 ? pages / report->seconds : 0;
+    report->cpu_ns_per_page = (double) cpu_ns / divisor;
+    report->allocations_per_page = (double) allocations / divisor;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static double median_of(double *values, u_int32_t count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * @brief Combine the reports of repeated runs into the median of every metric, a single slow
+ *  or fast run (e.g. because of the scheduling of the process) does not change the result.
+ *
+ * @param reports reports of the runs
+ * @param count number of reports, at least 1 and at most PERF_MAX_RUNS
+ * @param median filled with the median of every metric
+ */
+void perf_median(const PerfReport *reports, u_int32_t count, PerfReport *median)
+{
+    double values[PERF_MAX_RUNS];
+
+    for (u_int32_t i = 0; i < count; ++i)
+        values[i] = reports[i].pages;
+    median->pages = (u_int32_t) median_of(values, count);
+
+    for (u_int32_t i = 0; i < count; ++i)
+        values[i] = reports[i].seconds;
+    median->seconds = median_of(values, count);
+
+    for (u_int32_t i = 0; i < count; ++i)
+        values[i] = reports[i].pages_per_second;
+    median->pages_per_second = median_of(values, count);
+
+    for (u_int32_t i = 0; i < count; ++i)
+        values[i] = reports[i].cpu_ns_per_page;
+    median->cpu_ns_per_page = median_of(values, count);
+
+    for (u_int32_t i = 0; i < count; ++i)
+        values[i] = reports[i].allocations_per_page;
+    median->allocations_per_page = median_of(values, count);
+}
+
+/**
+ * @brief Write the report as "name value" lines, which can be read back as baseline with
+ *  perf_read_report.
+ *
+ * @param report report
+ * @param stream stream the report is written to
+ */
+void perf_write_report(const PerfReport *report, FILE *stream)
+{
+    fprintf(stream, "pages %u\n", report->pages);
+    fprintf(stream, "seconds %.6f\n", report->seconds);
+    fprintf(stream, "pages_per_second %.2f\n", report->pages_per_second);
+    fprintf(stream, "cpu_ns_per_page %.1f\n", report->cpu_ns_per_page);
+    fprintf(stream, "allocations_per_page %.2f\n", report->allocations_per_page);
+}
+
+/**
+ * @brief Read a report that was written with perf_write_report.
+ *
+ * @param path path of the report
+ * @param report filled with the report
+ * @return int 0 if the report was read, -1 if it could not be opened or is incomplete (like
+ *  reports that measured cycles instead of cpu time)
+ */
+int perf_read_report(const char *path, PerfReport *report)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    char name[64];
+    double value;
+    int found = 0;
+
+    while (fscanf(file, "%63s %lf", name, &value) == 2) {
+        if (strcmp(name, "pages") == 0) {
+            report->pages = (u_int32_t) value;
+            found |= 0x01;
+        } else if (strcmp(name, "seconds") == 0) {
+            report->seconds = value;
+            found |= 0x02;
+        } else if (strcmp(name, "pages_per_second") == 0) {
+            report->pages_per_second = value;
+            found |= 0x04;
+        } else if (strcmp(name, "cpu_ns_per_page") == 0) {
+            report->cpu_ns_per_page = value;
+            found |= 0x08;
+        } else if (strcmp(name, "allocations_per_page") == 0) {
+            report->allocations_per_page = value;
+            found |= 0x10;
+        }
+    }
+
+    fclose(file);
+
+    return found == 0x1F ? 0 : -1;
+}
+
+static int compare_metric(FILE *stream, const char *name, double value, double baseline, double threshold,
+    int higher_is_better)
+{
+    double change = baseline > 0 ? (value - baseline) / baseline * 100 : 0;
+    int regressed = higher_is_better ? change < -threshold : change > threshold;
+
+    fprintf(stream, "[PERF]: %-20s %14.2f (baseline %.2f, %+.1f%%)%s\n", name, value, baseline, change,
+        regressed ? " REGRESSION" : "");
+
+    return regressed;
+}
+
+/**
+ * @brief Compare a report with a baseline and print the result. Per page metrics are only
+ *  comparable if both runs fetched the same pages, so a different page count is reported as
+ *  regression as well.
+ *
+ * @param report report of the current run
+ * @param baseline report of the baseline run
+ * @param threshold change in percent that is tolerated before a metric counts as regressed
+ * @param stream stream the comparison is printed to
+ * @return u_int32_t number of regressed metrics
+ */
+u_int32_t perf_compare(const PerfReport *report, const PerfReport *baseline, double threshold, FILE *stream)
+{
+    u_int32_t regressions = 0;
+
+    if (report->pages != baseline->pages) {
+        fprintf(stream, "[PERF]: %-20s %14u (baseline %u) MISMATCH\n", "pages", report->pages, baseline->pages);
+        regressions++;
+    }
+
+    regressions += compare_metric(stream, "pages/s", report->pages_per_second, baseline->pages_per_second, threshold, 1);
+    regressions += compare_metric(stream, "cpu ns/page", report->cpu_ns_per_page, baseline->cpu_ns_per_page, threshold, 0);
+    regressions += compare_metric(stream, "allocations/page", report->allocations_per_page,
+        baseline->allocations_per_page, threshold, 0);
+
+    return regressions;
+}
\ No newline at end of file
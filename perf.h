@@ -0,0 +1,47 @@
+#ifndef LIBPERF
+#define LIBPERF
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/* A capture compared with a report of itself differs by more than 10% in about 1 of 10 runs. */
+#define DEFAULT_PERF_THRESHOLD 15.0
+
+/* A measured replay is repeated at least DEFAULT_PERF_RUNS times and until the runs took
+   PERF_MIN_SECONDS in total, the median run is reported. */
+#define DEFAULT_PERF_RUNS 5
+#define PERF_MIN_SECONDS 1.0
+#define PERF_MAX_RUNS 1000
+
+/* Runs shorter than this are dominated by fixed costs and noise, they are not compared with a baseline. */
+#define PERF_MIN_RUN_SECONDS 0.01
+
+typedef struct PerfTimer {
+    u_int64_t start_ns;
+    u_int64_t start_cpu_ns;
+    u_int64_t start_allocations;
+} PerfTimer;
+
+/* Throughput of a crawl. The cpu time is the time the process spent on the cpu (user and system),
+   waiting for the network is not included. */
+typedef struct PerfReport {
+    u_int32_t pages;
+    double seconds;
+    double pages_per_second;
+    double cpu_ns_per_page;
+    double allocations_per_page;
+} PerfReport;
+
+void perf_start(PerfTimer *timer);
+
+void perf_stop(const PerfTimer *timer, u_int32_t pages, PerfReport *report);
+
+void perf_median(const PerfReport *reports, u_int32_t count, PerfReport *median);
+
+void perf_write_report(const PerfReport *report, FILE *stream);
+
+int perf_read_report(const char *path, PerfReport *report);
+
+u_int32_t perf_compare(const PerfReport *report, const PerfReport *baseline, double threshold, FILE *stream);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include <stdint.h>
+#include <unistd.h>
+
+#include "replay.h"
+
+#define REPLAY_INITIAL_SLOTS 256
+#define REPLAY_DRAIN_SIZE 512
+
+
+/**
+ * @brief Create the capture file, an existing file is overwritten.
+ *
+ * @param path path of the capture file
+ * @return Capture* the capture, has to be closed with capture_close
+ */
+Capture *capture_open(const char *path)
+{
+    Capture *capture = mem_alloc(MEMORY_REPLAY, sizeof(Capture));
+    if (!capture)
+        error_exit("malloc failed when creating capture");
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file)
+        error_exit("fopen failed when creating capture file");
+
+    capture->records = 0;
+
+    if (fwrite(CAPTURE_MAGIC, 1, strlen(CAPTURE_MAGIC), capture->file) != strlen(CAPTURE_MAGIC))
+        error_exit("fwrite failed when writing capture file");
+
+    return capture;
+}
+
+/**
+ * @brief Append the exchange of a single page to the capture.
+ *
+ * @param capture capture
+ * @param url url of the page
+ * @param url_length length of the url
+ * @param request request that was sent
+ * @param request_length length of the request
+ * @param response everything that was received (headers and undecoded body)
+ * @param response_length length of the response, responses of 4GiB and more are cut off
+ */
+void capture_record(Capture *capture, const char *url, size_t url_length, const char *request,
+    size_t request_length, const char *response, size_t response_length)
+{
+    u_int32_t lengths[3];
+
+    lengths[0] = (u_int32_t) url_length;
+    lengths[1] = (u_int32_t) request_length;
+    lengths[2] = response_length > UINT32_MAX ? UINT32_MAX : (u_int32_t) response_length;
+
+    if (fwrite(lengths, sizeof(u_int32_t), 3, capture->file) != 3
+        || fwrite(url, 1, lengths[0], capture->file) != lengths[0]
+        || fwrite(request, 1, lengths[1], capture->file) != lengths[1]
+        || fwrite(response, 1, lengths[2], capture->file) != lengths[2])
+        error_exit("fwrite failed when writing capture file");
+
+    capture->records++;
+}
+
+void capture_close(Capture *capture)
+{
+    if (!capture)
+        return;
+
+    if (fclose(capture->file) == EOF)
+        error_exit("fclose failed when closing capture file");
+
+    mem_free(capture);
+}
+
+static u_int32_t hash_url(const char *url, size_t length)
+{
+    //32 bit FNV-1a
+    u_int32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) url[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Find the slot of the url, which is either the slot of its entry or the empty
+ *  slot the entry would be put into.
+ */
+static u_int32_t find_slot(const Replay *replay, const char *url, size_t length)
+{
+    u_int32_t slot = hash_url(url, length) & (replay->slot_count - 1);
+
+    while (replay->slots[slot] != 0) {
+        const ReplayEntry *entry = &replay->entries[replay->slots[slot] - 1];
+
+        if (entry->url_length == length && memcmp(&replay->data[entry->url_offset], url, length) == 0)
+            break;
+        slot = (slot + 1) & (replay->slot_count - 1);
+    }
+
+    return slot;
+}
+
+static void replay_grow(Replay *replay)
+{
+    u_int32_t *old_slots = replay->slots;
+    u_int32_t old_slot_count = replay->slot_count;
+
+    replay->slot_count *= 2;
+    replay->slots = mem_calloc(MEMORY_REPLAY, replay->slot_count, sizeof(u_int32_t));
+    replay->entries = mem_realloc(MEMORY_REPLAY, replay->entries, replay->slot_count / 2 * sizeof(ReplayEntry));
+    if (!replay->slots || !replay->entries)
+        error_exit("malloc failed when growing replay index");
+
+    for (u_int32_t i = 0; i < old_slot_count; ++i) {
+        if (old_slots[i] == 0)
+            continue;
+
+        const ReplayEntry *entry = &replay->entries[old_slots[i] - 1];
+        replay->slots[find_slot(replay, &replay->data[entry->url_offset], entry->url_length)] = old_slots[i];
+    }
+
+    mem_free(old_slots);
+}
+
+/**
+ * @brief Load a capture file that was written with --capture. If an url has been recorded
+ *  more than once, the first record is used.
+ *
+ * @param path path of the capture file
+ * @return Replay* the loaded capture, has to be freed with replay_free
+ */
+Replay *replay_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        error_exit("fopen failed when opening capture file");
+
+    Replay *replay = mem_calloc(MEMORY_REPLAY, 1, sizeof(Replay));
+    if (!replay)
+        error_exit("calloc failed when loading capture");
+
+    if (fseek(file, 0, SEEK_END) == -1)
+        error_exit("fseek failed when loading capture");
+    long size = ftell(file);
+    if (size == -1)
+        error_exit("ftell failed when loading capture");
+    rewind(file);
+
+    replay->size = (size_t) size;
+    replay->data = mem_alloc(MEMORY_REPLAY, replay->size > 0 ? replay->size : 1);
+    if (!replay->data)
+        error_exit("malloc failed when loading capture");
+
+    if (fread(replay->data, 1, replay->size, file) != replay->size)
+        error_exit("fread failed when loading capture");
+    fclose(file);
+
+    size_t magic_length = strlen(CAPTURE_MAGIC);
+    if (replay->size < magic_length || memcmp(replay->data, CAPTURE_MAGIC, magic_length) != 0)
+        error_exit_custom("Capture file is not a spoder capture");
+
+    replay->slot_count = REPLAY_INITIAL_SLOTS;
+    replay->slots = mem_calloc(MEMORY_REPLAY, replay->slot_count, sizeof(u_int32_t));
+    replay->entries = mem_alloc(MEMORY_REPLAY, replay->slot_count / 2 * sizeof(ReplayEntry));
+    if (!replay->slots || !replay->entries)
+        error_exit("malloc failed when loading capture");
+
+    size_t offset = magic_length;
+
+    while (offset < replay->size) {
+        u_int32_t lengths[3];
+
+        if (replay->size - offset < sizeof(lengths))
+            error_exit_custom("Capture file is truncated");
+        memcpy(lengths, &replay->data[offset], sizeof(lengths));
+        offset += sizeof(lengths);
+
+        if (replay->size - offset < (size_t) lengths[0] + lengths[1] + lengths[2])
+            error_exit_custom("Capture file is truncated");
+
+        ReplayEntry entry;
+        entry.url_offset = offset;
+        entry.url_length = lengths[0];
+        entry.response_offset = offset + lengths[0] + lengths[1];
+        entry.response_length = lengths[2];
+        offset = entry.response_offset + entry.response_length;
+
+        u_int32_t slot = find_slot(replay, &replay->data[entry.url_offset], entry.url_length);
+        if (replay->slots[slot] != 0)
+            continue;
+
+        replay->entries[replay->count++] = entry;
+        replay->slots[slot] = replay->count;
+
+        //Keep the load factor at or below 1/2, the entries array always has room for slot_count / 2 entries
+        if (replay->count >= replay->slot_count / 2)
+            replay_grow(replay);
+    }
+
+    return replay;
+}
+
+/**
+ * @brief Look up the recorded response of an url.
+ *
+ * @param replay loaded capture
+ * @param url normalized url, does not have to be null terminated
+ * @param length length of the url
+ * @param response set to the recorded response
+ * @param response_length set to the length of the response
+ * @return int 0 if the url has been recorded, -1 otherwise
+ */
+int replay_find(const Replay *replay, const char *url, size_t length, const char **response, size_t *response_length)
+{
+    u_int32_t slot = find_slot(replay, url, length);
+    if (replay->slots[slot] == 0)
+        return -1;
+
+    const ReplayEntry *entry = &replay->entries[replay->slots[slot] - 1];
+    *response = &replay->data[entry->response_offset];
+    *response_length = entry->response_length;
+
+    return 0;
+}
+
+void replay_free(Replay *replay)
+{
+    if (!replay)
+        return;
+
+    mem_free(replay->data);
+    mem_free(replay->entries);
+    mem_free(replay->slots);
+    mem_free(replay);
+}
+
+/**
+ * @brief Connect to a recorded response instead of a server. The connection is one end of a
+ *  socketpair, so it is read through connection_read like a real plain text connection,
+ *  the response is written into the other end by replay_pump.
+ *
+ * @param connection filled with the non-blocking socket
+ * @param stream filled with the serving end of the socketpair
+ * @param response recorded response, has to stay valid until the stream is closed
+ * @param length length of the response
+ * @return int 0 if the connection was established, -1 otherwise
+ */
+int replay_connect(Connection *connection, ReplayStream *stream, const char *response, size_t length)
+{
+    int fds[2];
+
+    connection->ssl = NULL;
+    connection->socket_fd = -1;
+    stream->fd = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return -1;
+
+    connection->socket_fd = fds[0];
+    stream->fd = fds[1];
+    stream->response = response;
+    stream->length = length;
+    stream->written = 0;
+
+    if (set_non_blocking(fds[0]) == -1 || set_non_blocking(fds[1]) == -1)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Write as much of the response as the socket buffer takes without blocking, the
+ *  serving end is closed once the whole response has been written. Has to be called before
+ *  every read of the connection, the request has to have been sent completely.
+ *
+ * @param stream stream
+ * @return int 0 on success, -1 if an error occured
+ */
+int replay_pump(ReplayStream *stream)
+{
+    char discard[REPLAY_DRAIN_SIZE];
+
+    if (stream->fd < 0)
+        return 0;
+
+    //Unread data makes close reset the connection, so the request is drained first
+    while (read(stream->fd, discard, sizeof(discard)) > 0)
+        ;
+
+    while (stream->written < stream->length) {
+        ssize_t bytes = write(stream->fd, &stream->response[stream->written], stream->length - stream->written);
+
+        if (bytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+            return -1;
+        }
+
+        stream->written += (size_t) bytes;
+    }
+
+    replay_stream_close(stream);
+    return 0;
+}
+
+void replay_stream_close(ReplayStream *stream)
+{
+    if (stream->fd >= 0) {
+        close(stream->fd);
+        stream->fd = -1;
+    }
+}
\ No newline at end of file
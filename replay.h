@@ -0,0 +1,62 @@
+#ifndef LIBREPLAY
+#define LIBREPLAY
+
+#include <sys/types.h>
+
+#include "connection.h"
+
+/* Every capture file starts with this line, followed by the recorded exchanges. */
+#define CAPTURE_MAGIC "SPODER CAPTURE 1\n"
+
+/* Records the plaintext exchange of every fetched page. A record consists of the lengths of the
+   url, the request and the response (u_int32_t each, host byte order) followed by their bytes. */
+typedef struct Capture {
+    FILE *file;
+    u_int32_t records;
+} Capture;
+
+typedef struct ReplayEntry {
+    size_t url_offset;              /* offsets into the data of the replay */
+    u_int32_t url_length;
+    size_t response_offset;
+    u_int32_t response_length;
+} ReplayEntry;
+
+/* A capture file loaded into memory, the responses are looked up by url. */
+typedef struct Replay {
+    char *data;
+    size_t size;
+    ReplayEntry *entries;
+    u_int32_t count;
+    u_int32_t *slots;               /* open addressing, stores index+1, 0 marks an empty slot */
+    u_int32_t slot_count;
+} Replay;
+
+/* Serving end of a socketpair, the other end is read by the fetch task like any other connection. */
+typedef struct ReplayStream {
+    int fd;                         /* -1 once the whole response has been written */
+    const char *response;
+    size_t length;
+    size_t written;
+} ReplayStream;
+
+Capture *capture_open(const char *path);
+
+void capture_record(Capture *capture, const char *url, size_t url_length, const char *request,
+    size_t request_length, const char *response, size_t response_length);
+
+void capture_close(Capture *capture);
+
+Replay *replay_load(const char *path);
+
+int replay_find(const Replay *replay, const char *url, size_t length, const char **response, size_t *response_length);
+
+void replay_free(Replay *replay);
+
+int replay_connect(Connection *connection, ReplayStream *stream, const char *response, size_t length);
+
+int replay_pump(ReplayStream *stream);
+
+void replay_stream_close(ReplayStream *stream);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,702 @@
+#include "scheduler.h"
+
+#define PAUSE_NONE 0
+#define PAUSE_OUTPUT 1
+#define PAUSE_FRONTIER 2
+#define PAUSE_MEMORY 3
+#define PAUSE_PAGES 4
+
+
+/**
+ * @brief Write output of a page. Only one page at a time, the output owner, writes to the
+ *  output directly. The other pages hold their output back until they become the owner or
+ *  are finished, so the output of a page is never split by the output of another page.
+ *  If the held back output hits the memory cap, the task fails.
+ */
+static void write_page_output(Scheduler *scheduler, FetchTask *task, const char *data, size_t length)
+{
+    if (!scheduler->output_owner) {
+        scheduler->output_owner = task;
+
+        if (task->text.used_size > 0)
+            output_write(scheduler->output, task->text.data, task->text.used_size);
+        text_buffer_free(&task->text);
+    }
+
+    if (scheduler->output_owner == task)
+        output_write(scheduler->output, data, length);
+    else if (text_buffer_append(&task->text, data, length) < 0)
+        task->out_of_memory = 1;
+}
+
+/**
+ * @brief Terminate the output of a finished page. Pages that finished while another page
+ *  owned the output are written once the owner is finished.
+ *
+ * @return int 0 on success, -1 if the output of the page had to be dropped because of the memory cap
+ */
+static int finish_page_output(Scheduler *scheduler, FetchTask *task)
+{
+    if (scheduler->output_owner != task && task->text.used_size == 0 && task->state != FETCH_DONE)
+        return 0;
+
+    if (scheduler->output_owner && scheduler->output_owner != task) {
+        if (text_buffer_reserve(&scheduler->finished_pages, task->text.used_size + 1) < 0)
+            return -1;
+
+        text_buffer_append(&scheduler->finished_pages, task->text.data, task->text.used_size);
+        text_buffer_append(&scheduler->finished_pages, "\n", 1);
+        return 0;
+    }
+
+    if (task->text.used_size > 0)
+        output_write(scheduler->output, task->text.data, task->text.used_size);
+    output_write(scheduler->output, "\n", 1);
+
+    scheduler->output_owner = NULL;
+
+    if (scheduler->finished_pages.used_size > 0) {
+        output_write(scheduler->output, scheduler->finished_pages.data, scheduler->finished_pages.used_size);
+        text_buffer_free(&scheduler->finished_pages);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the amount of output that is held back because another page owns the output.
+ */
+static size_t held_back_output(const Scheduler *scheduler)
+{
+    size_t size = scheduler->finished_pages.used_size;
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i)
+        size += scheduler->tasks[i]->text.used_size;
+
+    return size;
+}
+
+static void handle_text(void *owner, FetchTask *task, const char *text, size_t length)
+{
+    Scheduler *scheduler = owner;
+
+    write_page_output(scheduler, task, text, length);
+}
+
+/**
+ * @brief Get the id of the host of an url.
+ *
+ * @return u_int32_t id of the host, HOST_TABLE_FULL if the memory cap has been reached
+ */
+static u_int32_t intern_url_host(Scheduler *scheduler, const char *url, size_t length)
+{
+    UrlComponents components;
+    parse_url(url, length, &components);
+
+    return host_table_intern(scheduler->fetch_context.hosts, &url[components.host.offset], components.host.length);
+}
+
+/**
+ * @brief Add a host to the crawl scope.
+ *
+ * @return int 0 on success, -1 if the memory cap has been reached
+ */
+static int add_to_scope(Scheduler *scheduler, u_int32_t host_id)
+{
+    if (host_id >= scheduler->host_scope_size) {
+        u_int32_t size = scheduler->host_scope_size ? scheduler->host_scope_size : 16;
+        while (size <= host_id)
+            size *= 2;
+
+        u_int8_t *host_in_scope = mem_realloc(MEMORY_HOSTS, scheduler->host_in_scope, size * sizeof(u_int8_t));
+        if (!host_in_scope)
+            return -1;
+
+        scheduler->host_in_scope = host_in_scope;
+        memset(&scheduler->host_in_scope[scheduler->host_scope_size], 0, size - scheduler->host_scope_size);
+        scheduler->host_scope_size = size;
+    }
+
+    scheduler->host_in_scope[host_id] = 1;
+    return 0;
+}
+
+static int is_in_scope(Scheduler *scheduler, u_int32_t host_id)
+{
+    return host_id < scheduler->host_scope_size && scheduler->host_in_scope[host_id];
+}
+
+/**
+ * @brief Count a link that is lost because of the memory cap, the first loss is reported
+ *  right away, as the crawl is incomplete from then on.
+ */
+static void drop_link(Scheduler *scheduler)
+{
+    if (scheduler->stats.links_dropped++ == 0)
+        fprintf(stderr, "[WARNING]: ./spoder: %s, found links are dropped\n", MEMORY_CAP_REACHED);
+}
+
+/**
+ * @brief Free the memory of the dns cache, of the urls the frontier keeps in memory and of the
+ *  output batch.
+ *
+ * @param only_large if set, only subsystems that hold a meaningful share of the memory cap are
+ *  evicted, and only until the usage is below the low water mark
+ */
+static void evict_memory(Scheduler *scheduler, u_int8_t only_large)
+{
+    if (scheduler->fetch_context.dns_cache.size > 0 && (!only_large || memory_holds_share(MEMORY_DNS))) {
+        dns_cache_free(&scheduler->fetch_context.dns_cache);
+        scheduler->stats.dns_evictions++;
+    }
+
+    if (!only_large || (!memory_below_low_water() && memory_holds_share(MEMORY_FRONTIER)))
+        frontier_spill(scheduler->frontier, FRONTIER_KEEP_IN_MEMORY);
+
+    //Blocks if the output is slow, but a full batch is worse than a short stall
+    if (!only_large || (!memory_below_low_water() && memory_holds_share(MEMORY_OUTPUT))) {
+        output_flush(scheduler->output);
+        output_shrink(scheduler->output);
+    }
+}
+
+/**
+ * @brief Queue a link as soon as a task finds it. Only links to the hosts of the seed (and
+ *  the hosts the seed redirects to) are followed, and only as long as the page and depth
+ *  budgets allow it. Links that can not be queued because of the memory cap are dropped.
+ *  While replaying, links are not queued, the captured urls are fetched instead.
+ */
+static void handle_link(void *owner, FetchTask *task, const char *url, size_t length, u_int8_t is_redirect)
+{
+    Scheduler *scheduler = owner;
+    u_int32_t host_id = intern_url_host(scheduler, url, length);
+    u_int32_t depth = task->depth;
+
+    if (scheduler->verbose) {
+        write_page_output(scheduler, task, is_redirect ? "\n[REDIRECT]: " : "\n[LINK]: ", is_redirect ? 13 : 9);
+        write_page_output(scheduler, task, url, length);
+        write_page_output(scheduler, task, "\n", 1);
+    }
+
+    if (scheduler->fetch_context.replay)
+        return;
+
+    if (host_id == HOST_TABLE_FULL) {
+        drop_link(scheduler);
+        return;
+    }
+
+    if (is_redirect) {
+        if (task->depth == 0 && add_to_scope(scheduler, host_id) < 0) {
+            drop_link(scheduler);
+            return;
+        }
+    } else {
+        if (!scheduler->recursive || task->depth >= scheduler->limits.max_depth)
+            return;
+        depth++;
+    }
+
+    if (!is_in_scope(scheduler, host_id))
+        return;
+
+    //Links beyond the page budget would never be fetched, they are only counted (once per url)
+    //to report why the crawl stopped. If the seen set is full, a url may be counted again.
+    if (scheduler->limits.max_pages
+        && scheduler->stats.pages_started + frontier_size(scheduler->frontier) >= scheduler->limits.max_pages) {
+        if (frontier_mark_seen(scheduler->frontier, url, length) != 0)
+            scheduler->stats.links_over_budget++;
+        return;
+    }
+
+    if (frontier_push(scheduler->frontier, url, length, depth) != -1)
+        return;
+
+    //The seen set could not grow, make room for it and try again
+    evict_memory(scheduler, 0);
+
+    if (frontier_push(scheduler->frontier, url, length, depth) == -1)
+        drop_link(scheduler);
+}
+
+/**
+ * @brief Create a scheduler with an empty frontier.
+ *
+ * @param ssl_ctx context used for all https connections
+ * @param output writer the text of the fetched pages is written to
+ * @param limits budget and timeouts of the crawl
+ * @param recursive if set, found links are followed
+ * @param verbose if set, found links are written to the output as well
+ * @return Scheduler* the scheduler, has to be freed with scheduler_free
+ */
+Scheduler *scheduler_create(SSL_CTX *ssl_ctx, OutputWriter *output, const CrawlLimits *limits,
+    u_int8_t recursive, u_int8_t verbose)
+{
+    Scheduler *scheduler = mem_calloc(MEMORY_OTHER, 1, sizeof(Scheduler));
+    if (!scheduler)
+        error_exit("calloc failed when creating scheduler");
+
+    scheduler->fetch_context.ssl_ctx = ssl_ctx;
+    scheduler->fetch_context.hosts = host_table_create();
+    scheduler->fetch_context.connect_timeout = limits->connect_timeout;
+    scheduler->fetch_context.tls_timeout = limits->tls_timeout;
+    scheduler->fetch_context.read_timeout = limits->read_timeout;
+    scheduler->fetch_context.on_text = handle_text;
+    scheduler->fetch_context.on_link = handle_link;
+    scheduler->fetch_context.owner = scheduler;
+
+    scheduler->frontier = frontier_create();
+    scheduler->output = output;
+    scheduler->finished_pages.subsystem = MEMORY_OUTPUT;
+    scheduler->limits = *limits;
+    scheduler->recursive = recursive;
+    scheduler->verbose = verbose;
+
+    return scheduler;
+}
+
+/**
+ * @brief Queue the url the crawl starts at, its host is added to the crawl scope.
+ *
+ * @param scheduler scheduler
+ * @param url normalized url
+ * @param length length of the url
+ * @return int 1 if the url was queued, 0 if it had been queued before
+ */
+int scheduler_add_seed(Scheduler *scheduler, const char *url, size_t length)
+{
+    u_int32_t host_id = intern_url_host(scheduler, url, length);
+
+    if (host_id == HOST_TABLE_FULL || add_to_scope(scheduler, host_id) < 0)
+        error_exit("malloc failed when adding seed host");
+
+    return frontier_push(scheduler->frontier, url, length, 0) == 1;
+}
+
+static void finish_task(Scheduler *scheduler, FetchTask *task)
+{
+    //Failed exchanges are recorded as well, so a replay fails the same pages
+    if (scheduler->fetch_context.capture && task->captured.used_size > 0)
+        capture_record(scheduler->fetch_context.capture, task->url.data, task->url.used_size, task->request.data,
+            task->request.used_size, task->captured.data, task->captured.used_size);
+
+    if (finish_page_output(scheduler, task) < 0) {
+        task->state = FETCH_FAILED;
+        task->error = MEMORY_CAP_REACHED;
+    }
+
+    if (task->state == FETCH_DONE) {
+        scheduler->stats.pages_fetched++;
+
+        if (scheduler->verbose)
+            fprintf(stderr, "[FETCHED]: %s (status %d, %zu bytes)\n", task->url.data, task->status_code, task->body_size);
+    } else {
+        scheduler->stats.pages_failed++;
+        fprintf(stderr, "[WARNING]: ./spoder: %s: %s\n", task->url.data, task->error);
+    }
+
+    fetch_task_free(task);
+}
+
+static void remove_task(Scheduler *scheduler, u_int32_t index)
+{
+    scheduler->active_count--;
+    scheduler->tasks[index] = scheduler->tasks[scheduler->active_count];
+    scheduler->events[index] = scheduler->events[scheduler->active_count];
+}
+
+/**
+ * @brief Abort all active tasks and stop the crawl.
+ *
+ * @param reason why the crawl is stopped
+ */
+static void stop_crawl(Scheduler *scheduler, const char *reason)
+{
+    scheduler->stats.stop_reason = reason;
+    fprintf(stderr, "[INFO]: ./spoder: Stopping crawl, %s\n", reason);
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i) {
+        scheduler->stats.pages_aborted++;
+        fetch_task_free(scheduler->tasks[i]);
+    }
+    scheduler->active_count = 0;
+
+    //The output of the aborted pages is dropped, the finished pages are still written
+    scheduler->output_owner = NULL;
+    if (scheduler->finished_pages.used_size > 0)
+        output_write(scheduler->output, scheduler->finished_pages.data, scheduler->finished_pages.used_size);
+    text_buffer_free(&scheduler->finished_pages);
+}
+
+/**
+ * @brief Take the next url that is replayed. A replay fetches the captured urls in the order
+ *  they were captured, so neither the order the tasks finish in nor the page budget decide
+ *  which pages are fetched, and every replay does the same work.
+ *
+ * @return int 1 if an url was taken, 0 if all captured urls have been replayed
+ */
+static int next_replayed_url(Scheduler *scheduler, const char **url, size_t *length)
+{
+    const Replay *replay = scheduler->fetch_context.replay;
+
+    if (scheduler->replay_next >= replay->count)
+        return 0;
+
+    const ReplayEntry *captured = &replay->entries[scheduler->replay_next++];
+    *url = &replay->data[captured->url_offset];
+    *length = captured->url_length;
+
+    return 1;
+}
+
+/**
+ * @brief Start tasks for the queued urls until the maximum number of active tasks or the
+ *  page budget is reached.
+ */
+static void start_tasks(Scheduler *scheduler)
+{
+    while (scheduler->active_count < MAX_ACTIVE_TASKS) {
+        FrontierEntry entry = { NULL, 0 };
+        const char *url;
+        size_t length;
+
+        //Every new task needs memory, wait for the active ones to finish first
+        if (scheduler->active_count > 0 && memory_headroom() < TASK_MEMORY_ESTIMATE)
+            return;
+
+        if (scheduler->fetch_context.replay) {
+            if (!next_replayed_url(scheduler, &url, &length))
+                return;
+        } else {
+            if (scheduler->limits.max_pages && scheduler->stats.pages_started >= scheduler->limits.max_pages) {
+                if (frontier_size(scheduler->frontier) > 0 || scheduler->stats.links_over_budget > 0)
+                    scheduler->stats.stop_reason = "page budget exhausted";
+                return;
+            }
+
+            if (!frontier_pop(scheduler->frontier, &entry)) {
+                //Queued urls that can not be taken out of the spill file with nothing left to free
+                if (frontier_size(scheduler->frontier) > 0 && scheduler->active_count == 0)
+                    scheduler->stats.stop_reason = MEMORY_CAP_REACHED;
+                return;
+            }
+
+            url = entry.url;
+            length = strlen(entry.url);
+        }
+
+        FetchTask *task = fetch_task_create(&scheduler->fetch_context, url, length, entry.depth);
+
+        if (!task && errno == ENOMEM) {
+            scheduler->stats.pages_started++;
+            scheduler->stats.pages_failed++;
+            fprintf(stderr, "[WARNING]: ./spoder: %.*s: %s\n", (int) length, url, MEMORY_CAP_REACHED);
+        }
+        mem_free(entry.url);
+
+        if (!task)
+            continue;
+
+        scheduler->stats.pages_started++;
+        scheduler->tasks[scheduler->active_count] = task;
+        scheduler->events[scheduler->active_count] = FETCH_YIELD;
+        scheduler->active_count++;
+    }
+}
+
+/**
+ * @brief Check whether the consumers of the tasks fall behind or the memory cap is close.
+ *  The output drains on its own, the frontier and the memory only when tasks finish.
+ *
+ * @return u_int8_t PAUSE_NONE, PAUSE_OUTPUT, PAUSE_PAGES, PAUSE_FRONTIER or PAUSE_MEMORY
+ */
+static u_int8_t check_backpressure(Scheduler *scheduler)
+{
+    u_int8_t pause = PAUSE_NONE;
+
+    if (output_pending(scheduler->output) >= OUTPUT_HIGH_WATER)
+        pause = PAUSE_OUTPUT;
+    else if (held_back_output(scheduler) >= OUTPUT_HIGH_WATER)
+        pause = PAUSE_PAGES;
+    else if (scheduler->frontier->count >= FRONTIER_HIGH_WATER)
+        pause = PAUSE_FRONTIER;
+    else if (memory_headroom() < MEMORY_PAUSE_HEADROOM)
+        pause = PAUSE_MEMORY;
+
+    if (pause != PAUSE_NONE && scheduler->paused == PAUSE_NONE)
+        scheduler->stats.backpressure_pauses++;
+
+    scheduler->paused = pause;
+    return pause;
+}
+
+/**
+ * @brief Decide whether a runnable task may be resumed. While paused, tasks do not receive
+ *  any more body data, so the servers are slowed down by tcp flow control. If the frontier or
+ *  the memory is the reason, one task keeps going, otherwise they could never drain. Held back
+ *  output only drains once the output owner is finished, so the owner keeps going.
+ */
+static int may_resume(Scheduler *scheduler, FetchTask *task, u_int8_t pause, u_int8_t *allow_one)
+{
+    if (pause == PAUSE_NONE || task->state != FETCH_RECEIVE_BODY)
+        return 1;
+
+    if (pause == PAUSE_PAGES && scheduler->output_owner)
+        return task == scheduler->output_owner;
+
+    if (*allow_one) {
+        *allow_one = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Resume every runnable task once.
+ */
+static void run_tasks(Scheduler *scheduler, u_int8_t pause)
+{
+    u_int8_t allow_one = pause == PAUSE_FRONTIER || pause == PAUSE_MEMORY || pause == PAUSE_PAGES;
+
+    for (u_int32_t i = 0; i < scheduler->active_count;) {
+        if (scheduler->events[i] != FETCH_YIELD || !may_resume(scheduler, scheduler->tasks[i], pause, &allow_one)) {
+            ++i;
+            continue;
+        }
+
+        short result = fetch_task_step(scheduler->tasks[i]);
+
+        if (result == FETCH_FINISHED) {
+            finish_task(scheduler, scheduler->tasks[i]);
+
+            //The last task was moved into the free slot, it is looked at in the next iteration
+            remove_task(scheduler, i);
+            continue;
+        }
+
+        scheduler->events[i] = result;
+        ++i;
+    }
+}
+
+static int has_runnable_task(Scheduler *scheduler, u_int8_t pause)
+{
+    u_int8_t allow_one = pause == PAUSE_FRONTIER || pause == PAUSE_MEMORY || pause == PAUSE_PAGES;
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i) {
+        if (scheduler->events[i] == FETCH_YIELD && may_resume(scheduler, scheduler->tasks[i], pause, &allow_one))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compute how long poll may wait before a timeout of a task or the deadline expires.
+ *
+ * @return int timeout in milliseconds, -1 if there is nothing to wait for
+ */
+static int compute_poll_timeout(Scheduler *scheduler)
+{
+    u_int64_t wake_at = scheduler->deadline_at;
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i) {
+        u_int64_t timeout_at = scheduler->tasks[i]->timeout_at;
+
+        if (scheduler->events[i] != FETCH_YIELD && timeout_at && (!wake_at || timeout_at < wake_at))
+            wake_at = timeout_at;
+    }
+
+    if (!wake_at)
+        return -1;
+
+    u_int64_t now = monotonic_ms();
+    if (wake_at <= now)
+        return 0;
+
+    return wake_at - now > INT_MAX ? INT_MAX : (int) (wake_at - now);
+}
+
+/**
+ * @brief Wait until at least one of the waiting tasks can continue and mark it as runnable,
+ *  write pending output once the output accepts it and fail the tasks whose timeout expired.
+ *
+ * @param any_runnable if set, poll does not wait at all
+ */
+static void wait_for_tasks(Scheduler *scheduler, int any_runnable)
+{
+    struct pollfd fds[MAX_ACTIVE_TASKS + 1];
+    u_int32_t task_indices[MAX_ACTIVE_TASKS];
+    nfds_t count = 0;
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i) {
+        if (scheduler->events[i] == FETCH_YIELD)
+            continue;
+
+        int fd = fetch_task_fd(scheduler->tasks[i]);
+
+        //Another task has already finished the dns lookup this task waited for
+        if (fd < 0) {
+            scheduler->events[i] = FETCH_YIELD;
+            any_runnable = 1;
+            continue;
+        }
+
+        fds[count].fd = fd;
+        fds[count].events = scheduler->events[i];
+        fds[count].revents = 0;
+        task_indices[count] = i;
+        count++;
+    }
+
+    nfds_t task_count = count;
+
+    if (output_pending(scheduler->output) > 0) {
+        fds[count].fd = scheduler->output->fd;
+        fds[count].events = POLLOUT;
+        fds[count].revents = 0;
+        count++;
+    }
+
+    int timeout = any_runnable ? 0 : compute_poll_timeout(scheduler);
+
+    if (count == 0 && timeout == -1)
+        return;
+
+    if (poll(fds, count, timeout) == -1) {
+        if (errno == EINTR)
+            return;
+        error_exit("poll failed");
+    }
+
+    if (count > task_count && fds[task_count].revents != 0)
+        output_flush_ready(scheduler->output);
+
+    for (nfds_t i = 0; i < task_count; ++i) {
+        //Errors and hang ups are reported by the next read or write of the task
+        if (fds[i].revents != 0)
+            scheduler->events[task_indices[i]] = FETCH_YIELD;
+    }
+
+    u_int64_t now = monotonic_ms();
+
+    for (u_int32_t i = 0; i < scheduler->active_count;) {
+        FetchTask *task = scheduler->tasks[i];
+
+        if (scheduler->events[i] == FETCH_YIELD || !task->timeout_at || task->timeout_at > now) {
+            ++i;
+            continue;
+        }
+
+        fetch_task_timeout(task);
+        finish_task(scheduler, task);
+        remove_task(scheduler, i);
+    }
+}
+
+/**
+ * @brief Free memory before the memory cap is reached: evict the dns cache, spill the frontier
+ *  to disk and write out the output batch. The pressure starts above the soft limit and lasts
+ *  until the usage is below the low water mark, so the crawl does not flip in and out of it.
+ *  Only subsystems holding a meaningful share of the cap are evicted, memory that can not be
+ *  freed (like the ssl context) does not make the crawler evict its caches over and over.
+ */
+static void relieve_memory_pressure(Scheduler *scheduler)
+{
+    if (!scheduler->memory_pressure) {
+        if (!memory_over_soft_limit())
+            return;
+
+        scheduler->memory_pressure = 1;
+        scheduler->stats.memory_pressure_episodes++;
+    } else if (memory_below_low_water()) {
+        scheduler->memory_pressure = 0;
+        return;
+    }
+
+    evict_memory(scheduler, 1);
+}
+
+/**
+ * @brief Crawl until the frontier is empty and all tasks are finished, or a budget is
+ *  exhausted. While one task parses a received chunk, the sockets of the other tasks keep
+ *  receiving, and links are queued (and fetched) as soon as they are found.
+ *
+ * @param scheduler scheduler
+ */
+void scheduler_run(Scheduler *scheduler)
+{
+    if (scheduler->limits.deadline)
+        scheduler->deadline_at = monotonic_ms() + scheduler->limits.deadline;
+
+    for (;;) {
+        if (scheduler->deadline_at && monotonic_ms() >= scheduler->deadline_at) {
+            stop_crawl(scheduler, "deadline reached");
+            break;
+        }
+
+        if (scheduler->limits.max_bytes && scheduler->fetch_context.bytes_received >= scheduler->limits.max_bytes) {
+            stop_crawl(scheduler, "byte budget exhausted");
+            break;
+        }
+
+        relieve_memory_pressure(scheduler);
+
+        start_tasks(scheduler);
+
+        if (scheduler->active_count == 0)
+            break;
+
+        run_tasks(scheduler, check_backpressure(scheduler));
+
+        wait_for_tasks(scheduler, has_runnable_task(scheduler, check_backpressure(scheduler)));
+    }
+
+    if (!scheduler->stats.stop_reason && scheduler->stats.links_dropped > 0)
+        scheduler->stats.stop_reason = "found links dropped because of the memory cap";
+
+    output_flush(scheduler->output);
+}
+
+/**
+ * @brief Print the statistics of the crawl.
+ *
+ * @param scheduler scheduler
+ * @param stream stream the statistics are printed to
+ */
+void scheduler_print_stats(const Scheduler *scheduler, FILE *stream)
+{
+    const CrawlStats *stats = &scheduler->stats;
+
+    fprintf(stream, "Pages started: %u, fetched: %u, failed: %u, aborted: %u\n",
+        stats->pages_started, stats->pages_fetched, stats->pages_failed, stats->pages_aborted);
+    fprintf(stream, "Bytes received: %llu\n", (unsigned long long) scheduler->fetch_context.bytes_received);
+    fprintf(stream, "Links dropped (memory cap reached): %u, beyond the page budget: %u\n", stats->links_dropped,
+        stats->links_over_budget);
+    fprintf(stream, "Backpressure pauses: %u\n", stats->backpressure_pauses);
+    fprintf(stream, "Memory pressure episodes: %u, dns cache evictions: %u, urls spilled to disk: %llu\n",
+        stats->memory_pressure_episodes, stats->dns_evictions, (unsigned long long) scheduler->frontier->spilled_total);
+
+    if (scheduler->fetch_context.capture)
+        fprintf(stream, "Exchanges captured: %u\n", scheduler->fetch_context.capture->records);
+
+    if (stats->stop_reason)
+        fprintf(stream, "Stopped early: %s\n", stats->stop_reason);
+
+    memory_print_stats(stream);
+}
+
+void scheduler_free(Scheduler *scheduler)
+{
+    if (!scheduler)
+        return;
+
+    for (u_int32_t i = 0; i < scheduler->active_count; ++i)
+        fetch_task_free(scheduler->tasks[i]);
+
+    frontier_free(scheduler->frontier);
+    host_table_free(scheduler->fetch_context.hosts);
+    dns_cache_free(&scheduler->fetch_context.dns_cache);
+    text_buffer_free(&scheduler->finished_pages);
+    mem_free(scheduler->host_in_scope);
+    mem_free(scheduler);
+}
@@ -0,0 +1,89 @@
+#ifndef LIBSCHEDULER
+#define LIBSCHEDULER
+
+#include <stdint.h>
+
+#include "fetch.h"
+#include "frontier.h"
+#include "output.h"
+
+#define MAX_ACTIVE_TASKS 8
+
+/* Above these marks the tasks stop receiving new data until the output or the frontier has caught up. */
+#define OUTPUT_HIGH_WATER (256 * 1024)
+#define FRONTIER_HIGH_WATER (FRONTIER_LIMIT / 2)
+
+/* Number of urls the frontier keeps in memory when it is spilled because of memory pressure */
+#define FRONTIER_KEEP_IN_MEMORY 64
+
+/* Rough upper bound of the memory an active task needs, TLS buffers included. New tasks are only
+   started while the memory cap leaves room for one more. */
+#define TASK_MEMORY_ESTIMATE (48 * 1024)
+/* Below this headroom the active tasks stop receiving data until memory has been freed. */
+#define MEMORY_PAUSE_HEADROOM (16 * 1024)
+
+#define UNLIMITED_DEPTH UINT32_MAX
+
+/* Budget of a crawl, 0 means unlimited (except for max_depth). Timeouts are given in milliseconds. */
+typedef struct CrawlLimits {
+    u_int32_t max_pages;
+    u_int32_t max_depth;
+    u_int64_t max_bytes;
+    u_int32_t connect_timeout;
+    u_int32_t tls_timeout;
+    u_int32_t read_timeout;
+    u_int32_t deadline;
+} CrawlLimits;
+
+typedef struct CrawlStats {
+    u_int32_t pages_started;
+    u_int32_t pages_fetched;
+    u_int32_t pages_failed;
+    u_int32_t pages_aborted;
+    u_int32_t links_dropped;        /* links that could not be queued because of the memory cap */
+    u_int32_t links_over_budget;    /* distinct links that were not queued because of the page budget */
+    u_int32_t backpressure_pauses;
+    u_int32_t dns_evictions;
+    u_int32_t memory_pressure_episodes;     /* times the usage went over the soft limit of the memory cap */
+    const char *stop_reason;        /* NULL if the crawl ran until the frontier was empty */
+} CrawlStats;
+
+/* Runs the fetch tasks cooperatively, resuming a task whenever its socket is ready. */
+typedef struct Scheduler {
+    FetchContext fetch_context;
+    Frontier *frontier;
+    OutputWriter *output;
+    CrawlLimits limits;
+    u_int64_t deadline_at;
+
+    FetchTask *tasks[MAX_ACTIVE_TASKS];
+    short events[MAX_ACTIVE_TASKS];     /* FETCH_YIELD if the task is runnable, otherwise the awaited poll events */
+    u_int32_t active_count;
+    u_int8_t paused;
+    u_int8_t memory_pressure;           /* set above the soft limit of the memory cap until the low water mark is reached */
+    u_int32_t replay_next;              /* index of the next captured exchange, only used while replaying */
+
+    FetchTask *output_owner;            /* the only task that writes to the output directly, NULL if none */
+    TextBuffer finished_pages;          /* output of pages that finished while another page owned the output */
+
+    u_int8_t *host_in_scope;            /* indexed by host id */
+    u_int32_t host_scope_size;
+
+    u_int8_t recursive;
+    u_int8_t verbose;
+
+    CrawlStats stats;
+} Scheduler;
+
+Scheduler *scheduler_create(SSL_CTX *ssl_ctx, OutputWriter *output, const CrawlLimits *limits,
+    u_int8_t recursive, u_int8_t verbose);
+
+int scheduler_add_seed(Scheduler *scheduler, const char *url, size_t length);
+
+void scheduler_run(Scheduler *scheduler);
+
+void scheduler_print_stats(const Scheduler *scheduler, FILE *stream);
+
+void scheduler_free(Scheduler *scheduler);
+
+#endif
\ No newline at end of file
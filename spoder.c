@@ -2,13 +2,35 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdint.h>
 
 #include "utilities.h"
-#include "connection.h"
-#include "parser.h"
-
-#define BUFFER_SIZE 2048
-#define TEXTBUFFER_SIZE 2048
+#include "scheduler.h"
+#include "perf.h"
+
+#define DEFAULT_CONNECT_TIMEOUT 10000
+#define DEFAULT_TLS_TIMEOUT 10000
+#define DEFAULT_READ_TIMEOUT 30000
+
+/* Options without a short form */
+enum {
+    OPTION_MAX_PAGES = 256,
+    OPTION_MAX_DEPTH,
+    OPTION_MAX_BYTES,
+    OPTION_CONNECT_TIMEOUT,
+    OPTION_TLS_TIMEOUT,
+    OPTION_READ_TIMEOUT,
+    OPTION_DEADLINE,
+    OPTION_MAX_MEMORY,
+    OPTION_CAPTURE,
+    OPTION_REPLAY,
+    OPTION_PERF_REPORT,
+    OPTION_PERF_BASELINE,
+    OPTION_PERF_THRESHOLD,
+    OPTION_PERF_RUNS
+};
 
 char *prog_name;
 
@@ -22,13 +44,30 @@ static void help(void)
     printf("USAGE: %s [OPTION]... URL\n\n", prog_name);
 
     printf("\t -h, --help \t\t Display this help and exit.\n");
-    printf("\t -p, --port \t\t Specify port to be used, if not provided 80 is used as default.\n");
+    printf("\t -p, --port \t\t Specify port to be used, if not provided the port of the URL is used (80 for http, 443 for https).\n");
     printf("\t -v, --verbose \t\t Verbose mode: Display more information.\n");
     printf("\t -o, --output \t\t Specify output file, if not provided stdout is used as default.\n");
     printf("\t -e, --email \t\t Also search for email addresses.\n");
     printf("\t -t, --tel \t\t Also search for phone numbers.\n");
     printf("\t -s, --sort \t\t Sort output by category (tel number, email, link).\n");
-    printf("\t -r, --recursive \t Follow found links.\n");
+    printf("\t -r, --recursive \t Follow found links that point to the host of the given URL.\n");
+    printf("\t --max-pages N \t\t Fetch at most N pages.\n");
+    printf("\t --max-depth N \t\t Follow at most N links in a row from the given URL.\n");
+    printf("\t --max-bytes N \t\t Stop the crawl after N bytes have been received.\n");
+    printf("\t --connect-timeout S \t Give up resolving or connecting after S seconds (default %d).\n", DEFAULT_CONNECT_TIMEOUT / 1000);
+    printf("\t --tls-timeout S \t Give up the TLS handshake after S seconds (default %d).\n", DEFAULT_TLS_TIMEOUT / 1000);
+    printf("\t --read-timeout S \t Give up a request after S seconds without receiving data (default %d).\n", DEFAULT_READ_TIMEOUT / 1000);
+    printf("\t --deadline S \t\t Stop the crawl after S seconds.\n");
+    printf("\t --max-memory SIZE \t Cap the memory usage at SIZE bytes (suffixes K, M and G are accepted).\n");
+    printf("\t --capture FILE \t Record every response of the crawl in FILE (not together with --deadline or --max-bytes).\n");
+    printf("\t --replay FILE \t\t Fetch the pages recorded in FILE in the recorded order instead of using the network,\n"
+        "\t\t\t\t the page budget and the found links do not change which pages are fetched.\n");
+    printf("\t --perf-report FILE \t Write pages/s, cpu ns/page and allocations/page of the crawl to FILE.\n");
+    printf("\t --perf-baseline FILE \t Compare the replay with a report written by --perf-report and fail if it regressed (requires --replay).\n");
+    printf("\t --perf-threshold P \t Tolerate regressions of up to P percent (default %.0f). The default is meant for captures of 200 pages or more,\n"
+        "\t\t\t\t replays shorter than %.0f ms can not be compared and fail.\n", DEFAULT_PERF_THRESHOLD, PERF_MIN_RUN_SECONDS * 1000);
+    printf("\t --perf-runs N \t\t Repeat a measured replay at least N times and for at least %.0f second, the median run is reported (default %d).\n",
+        PERF_MIN_SECONDS, DEFAULT_PERF_RUNS);
     
     exit(EXIT_SUCCESS);
 }
@@ -49,7 +88,8 @@ static void usage(const char *msg)
  * @brief Checks that the option has not been provided more often than the specified limit.
  *  If the option occurs more often than the specified limit, the usage function is called.
  * 
- * @param short_option short form of the option that has been provided (e.g. -h)
+ * @param short_option short form of the option that has been provided (e.g. -h), NULL if the
+ *  option has no short form
  * @param long_option  long form of the option that has been provided (e.g. --help)
  * @param limit specifies how often the option can occur at most.
  * @param option_counter how often the option has occured so far. If option_counter < limit, then
@@ -60,13 +100,147 @@ static void check_option_limit(const char *short_option, const char *long_option
 {
     if (*option_counter >= option_limit) {
         char buffer[1024];
-        sprintf(buffer, "Option -%s, --%s must not be given more than %s", short_option, long_option, limit);
+        if (short_option)
+            sprintf(buffer, "Option -%s, --%s must not be given more than %s", short_option, long_option, limit);
+        else
+            sprintf(buffer, "Option --%s must not be given more than %s", long_option, limit);
         usage(buffer);
     }
     (*option_counter)++;
 }
 
+/**
+ * @brief Parse the argument of an option that takes a non-negative integer. If the argument is
+ *  invalid, the usage function is called.
+ * 
+ * @param argument argument of the option
+ * @param min smallest accepted value
+ * @param max largest accepted value
+ * @param invalid_msg message passed to the usage function if the argument is invalid
+ * @return u_int64_t the parsed number
+ */
+static u_int64_t parse_number_argument(const char *argument, u_int64_t min, u_int64_t max, const char *invalid_msg)
+{
+    if (*argument == '\0' || *argument == '-')
+        usage(invalid_msg);
+
+    char *endptr;
+    errno = 0;
+    unsigned long long value = strtoull(argument, &endptr, 10);
+
+    if (*endptr != '\0' || errno == ERANGE || value < min || value > max)
+        usage(invalid_msg);
+
+    return value;
+}
+
+/**
+ * @brief Parse the argument of an option that takes a positive size in bytes, optionally
+ *  followed by one of the suffixes K, M or G. If the argument is invalid, the usage function
+ *  is called.
+ * 
+ * @param argument argument of the option
+ * @param invalid_msg message passed to the usage function if the argument is invalid
+ * @return size_t the parsed size in bytes
+ */
+static size_t parse_size_argument(const char *argument, const char *invalid_msg)
+{
+    if (*argument == '\0' || *argument == '-')
+        usage(invalid_msg);
+
+    char *endptr;
+    errno = 0;
+    unsigned long long value = strtoull(argument, &endptr, 10);
+
+    unsigned long long factor = 1;
+    if (*endptr == 'K' || *endptr == 'k')
+        factor = 1024ULL;
+    else if (*endptr == 'M' || *endptr == 'm')
+        factor = 1024ULL * 1024;
+    else if (*endptr == 'G' || *endptr == 'g')
+        factor = 1024ULL * 1024 * 1024;
+
+    if (factor != 1)
+        ++endptr;
+
+    if (endptr == argument || *endptr != '\0' || errno == ERANGE || value == 0 || value > SIZE_MAX / factor)
+        usage(invalid_msg);
 
+    return (size_t) (value * factor);
+}
+
+/**
+ * @brief Parse the argument of an option that takes a positive number of seconds (e.g. 2.5).
+ *  If the argument is invalid, the usage function is called.
+ * 
+ * @param argument argument of the option
+ * @param invalid_msg message passed to the usage function if the argument is invalid
+ * @return u_int32_t the parsed duration in milliseconds
+ */
+static u_int32_t parse_seconds_argument(const char *argument, const char *invalid_msg)
+{
+    char *endptr;
+    double seconds = strtod(argument, &endptr);
+
+    if (*argument == '\0' || *endptr != '\0' || !(seconds > 0) || seconds > UINT32_MAX / 1000.0)
+        usage(invalid_msg);
+
+    u_int32_t milliseconds = (u_int32_t) (seconds * 1000);
+    return milliseconds > 0 ? milliseconds : 1;
+}
+
+/**
+ * @brief Parse the argument of an option that takes a non-negative percentage (e.g. 2.5).
+ *  If the argument is invalid, the usage function is called.
+ * 
+ * @param argument argument of the option
+ * @param invalid_msg message passed to the usage function if the argument is invalid
+ * @return double the parsed percentage
+ */
+static double parse_percent_argument(const char *argument, const char *invalid_msg)
+{
+    char *endptr;
+    double percent = strtod(argument, &endptr);
+
+    if (*argument == '\0' || *endptr != '\0' || !(percent >= 0) || percent > 1e6)
+        usage(invalid_msg);
+
+    return percent;
+}
+
+/**
+ * @brief Crawl from the given url and measure the crawl.
+ * 
+ * @param ctx context used for all https connections
+ * @param output writer the text of the fetched pages is written to
+ * @param limits budget and timeouts of the crawl
+ * @param recursive if set, found links are followed
+ * @param verbose if set, found links are written to the output as well
+ * @param url normalized url the crawl starts at
+ * @param length length of the url
+ * @param capture capture the responses are recorded in, NULL if none
+ * @param replay capture the responses are served from, NULL to use the network
+ * @param report filled with the throughput of the crawl
+ * @return Scheduler* the finished crawl, has to be freed with scheduler_free
+ */
+static Scheduler *run_crawl(SSL_CTX *ctx, OutputWriter *output, const CrawlLimits *limits, u_int8_t recursive,
+    u_int8_t verbose, const char *url, size_t length, Capture *capture, Replay *replay, PerfReport *report)
+{
+    Scheduler *scheduler = scheduler_create(ctx, output, limits, recursive, verbose);
+    scheduler_add_seed(scheduler, url, length);
+
+    scheduler->fetch_context.capture = capture;
+    scheduler->fetch_context.replay = replay;
+
+    PerfTimer timer;
+
+    perf_start(&timer);
+    scheduler_run(scheduler);
+    //Failed pages are cheap, a replay that fails pages must not look like the same workload
+    perf_stop(&timer, scheduler->stats.pages_fetched, report);
+
+    return scheduler;
+}
 
 int main(int argc, char **argv)
 {
@@ -88,6 +262,20 @@ int main(int argc, char **argv)
         {"email", no_argument, NULL, 'e'},
         {"sort", no_argument, NULL, 's'},
         {"recursive", no_argument, NULL, 'r'},
+        {"max-pages", required_argument, NULL, OPTION_MAX_PAGES},
+        {"max-depth", required_argument, NULL, OPTION_MAX_DEPTH},
+        {"max-bytes", required_argument, NULL, OPTION_MAX_BYTES},
+        {"connect-timeout", required_argument, NULL, OPTION_CONNECT_TIMEOUT},
+        {"tls-timeout", required_argument, NULL, OPTION_TLS_TIMEOUT},
+        {"read-timeout", required_argument, NULL, OPTION_READ_TIMEOUT},
+        {"deadline", required_argument, NULL, OPTION_DEADLINE},
+        {"max-memory", required_argument, NULL, OPTION_MAX_MEMORY},
+        {"capture", required_argument, NULL, OPTION_CAPTURE},
+        {"replay", required_argument, NULL, OPTION_REPLAY},
+        {"perf-report", required_argument, NULL, OPTION_PERF_REPORT},
+        {"perf-baseline", required_argument, NULL, OPTION_PERF_BASELINE},
+        {"perf-threshold", required_argument, NULL, OPTION_PERF_THRESHOLD},
+        {"perf-runs", required_argument, NULL, OPTION_PERF_RUNS},
         0
     };
 
@@ -99,6 +287,20 @@ int main(int argc, char **argv)
     u_int8_t count_e = 0;
     u_int8_t count_s = 0;
     u_int8_t count_r = 0;
+    u_int8_t count_max_pages = 0;
+    u_int8_t count_max_depth = 0;
+    u_int8_t count_max_bytes = 0;
+    u_int8_t count_connect_timeout = 0;
+    u_int8_t count_tls_timeout = 0;
+    u_int8_t count_read_timeout = 0;
+    u_int8_t count_deadline = 0;
+    u_int8_t count_max_memory = 0;
+    u_int8_t count_capture = 0;
+    u_int8_t count_replay = 0;
+    u_int8_t count_perf_report = 0;
+    u_int8_t count_perf_baseline = 0;
+    u_int8_t count_perf_threshold = 0;
+    u_int8_t count_perf_runs = 0;
 
     u_int8_t is_verbose = 0;
     u_int8_t filter_tel = 0;
@@ -108,6 +310,23 @@ int main(int argc, char **argv)
     u_int8_t custom_port_provided = 0;
     char *port = "80";
     char *output_file = NULL;
+    size_t max_memory = 0;
+    char *capture_file = NULL;
+    char *replay_file = NULL;
+    char *perf_report_file = NULL;
+    char *perf_baseline_file = NULL;
+    double perf_threshold = DEFAULT_PERF_THRESHOLD;
+    u_int32_t perf_runs = DEFAULT_PERF_RUNS;
+
+    CrawlLimits limits = {
+        .max_pages = 0,
+        .max_depth = UNLIMITED_DEPTH,
+        .max_bytes = 0,
+        .connect_timeout = DEFAULT_CONNECT_TIMEOUT,
+        .tls_timeout = DEFAULT_TLS_TIMEOUT,
+        .read_timeout = DEFAULT_READ_TIMEOUT,
+        .deadline = 0
+    };
 
     while ((c = getopt_long(argc, argv, ":hvo:p:tesr", longoptions, longindex)) != -1) {
         switch(c) {
@@ -161,6 +380,80 @@ int main(int argc, char **argv)
 
                 search_recursive = 1;
                 break;
+            case OPTION_MAX_PAGES:
+                check_option_limit(NULL, "max-pages", "once", &count_max_pages, 1);
+
+                limits.max_pages = (u_int32_t) parse_number_argument(optarg, 1, UINT32_MAX,
+                    "Maximum number of pages must be a positive integer");
+                break;
+            case OPTION_MAX_DEPTH:
+                check_option_limit(NULL, "max-depth", "once", &count_max_depth, 1);
+
+                limits.max_depth = (u_int32_t) parse_number_argument(optarg, 0, UINT32_MAX - 1,
+                    "Maximum depth must be a non-negative integer");
+                break;
+            case OPTION_MAX_BYTES:
+                check_option_limit(NULL, "max-bytes", "once", &count_max_bytes, 1);
+
+                limits.max_bytes = parse_number_argument(optarg, 1, UINT64_MAX,
+                    "Maximum number of bytes must be a positive integer");
+                break;
+            case OPTION_CONNECT_TIMEOUT:
+                check_option_limit(NULL, "connect-timeout", "once", &count_connect_timeout, 1);
+
+                limits.connect_timeout = parse_seconds_argument(optarg, "Connect timeout must be a positive number of seconds");
+                break;
+            case OPTION_TLS_TIMEOUT:
+                check_option_limit(NULL, "tls-timeout", "once", &count_tls_timeout, 1);
+
+                limits.tls_timeout = parse_seconds_argument(optarg, "TLS timeout must be a positive number of seconds");
+                break;
+            case OPTION_READ_TIMEOUT:
+                check_option_limit(NULL, "read-timeout", "once", &count_read_timeout, 1);
+
+                limits.read_timeout = parse_seconds_argument(optarg, "Read timeout must be a positive number of seconds");
+                break;
+            case OPTION_DEADLINE:
+                check_option_limit(NULL, "deadline", "once", &count_deadline, 1);
+
+                limits.deadline = parse_seconds_argument(optarg, "Deadline must be a positive number of seconds");
+                break;
+            case OPTION_MAX_MEMORY:
+                check_option_limit(NULL, "max-memory", "once", &count_max_memory, 1);
+
+                max_memory = parse_size_argument(optarg, "Memory cap must be a positive size in bytes (e.g. 64M)");
+                break;
+            case OPTION_CAPTURE:
+                check_option_limit(NULL, "capture", "once", &count_capture, 1);
+
+                capture_file = optarg;
+                break;
+            case OPTION_REPLAY:
+                check_option_limit(NULL, "replay", "once", &count_replay, 1);
+
+                replay_file = optarg;
+                break;
+            case OPTION_PERF_REPORT:
+                check_option_limit(NULL, "perf-report", "once", &count_perf_report, 1);
+
+                perf_report_file = optarg;
+                break;
+            case OPTION_PERF_BASELINE:
+                check_option_limit(NULL, "perf-baseline", "once", &count_perf_baseline, 1);
+
+                perf_baseline_file = optarg;
+                break;
+            case OPTION_PERF_THRESHOLD:
+                check_option_limit(NULL, "perf-threshold", "once", &count_perf_threshold, 1);
+
+                perf_threshold = parse_percent_argument(optarg, "Performance threshold must be a non-negative percentage");
+                break;
+            case OPTION_PERF_RUNS:
+                check_option_limit(NULL, "perf-runs", "once", &count_perf_runs, 1);
+
+                perf_runs = (u_int32_t) parse_number_argument(optarg, 1, PERF_MAX_RUNS,
+                    "Number of performance runs must be an integer between 1 and 1000");
+                break;
             case '?':
                 usage("Invalid option provided");
             case ':':
@@ -174,6 +467,20 @@ int main(int argc, char **argv)
     if (argc - optind != 1)
         usage("URL must be given as positional argument");
 
+    if (capture_file && replay_file)
+        usage("Options --capture and --replay must not be given together");
+
+    //Pages aborted by these budgets are not recorded, a replay could not repeat the crawl
+    if (capture_file && (limits.deadline || limits.max_bytes))
+        usage("Option --capture must not be given together with --deadline or --max-bytes");
+
+    //Only replays are repeatable enough to be compared with a baseline
+    if (perf_baseline_file && !replay_file)
+        usage("Option --perf-baseline requires --replay");
+
+    if (count_perf_runs && !replay_file)
+        usage("Option --perf-runs requires --replay");
+
     char *url = strdup(argv[optind]);
 
 
@@ -181,169 +488,141 @@ int main(int argc, char **argv)
         usage("Invalid protocol given, only accepted protocols are:\n\t- http\n\t- https\n");
 
 
-    //TODO: Refactor extracting protocol, node, path etc. from given URL
+    TextBuffer normalized_url = { NULL, 0, 0, MEMORY_TEXT };
+    if (normalize_url(url, strlen(url), &normalized_url) < 0)
+        usage("Invalid URL given - malformed URL");
 
-    char *stripped_url = url_without_protocol(url);
+    UrlComponents components;
+    parse_url(normalized_url.data, normalized_url.used_size, &components);
 
-    check_valid_url(stripped_url);
+    check_valid_url(&normalized_url.data[components.host.offset]);
 
-    char *node = extract_node(stripped_url);
+    //The port given as option replaces the port of the url, links found on the page inherit it
+    if (custom_port_provided) {
+        TextBuffer url_with_port = { NULL, 0, 0, MEMORY_TEXT };
 
-    //TODO: extract path from url
+        if (text_buffer_reserve(&url_with_port, normalized_url.used_size + strlen(port) + 1) < 0)
+            error_exit("realloc failed when adding port to url");
 
+        text_buffer_append(&url_with_port, normalized_url.data, components.host.offset + components.host.length);
+        text_buffer_append(&url_with_port, ":", 1);
+        text_buffer_append(&url_with_port, port, strlen(port));
+        text_buffer_append(&url_with_port, &normalized_url.data[components.path.offset],
+            normalized_url.used_size - components.path.offset);
 
+        if (normalize_url(url_with_port.data, url_with_port.used_size, &normalized_url) < 0)
+            usage("Invalid URL given - malformed URL");
 
-    //TODO: Refactor into methods and do proper error handling
+        text_buffer_free(&url_with_port);
+    }
 
-    SSL_library_init();
-    OpenSSL_add_all_algorithms();
-    SSL_load_error_strings();
+    int output_fd = STDOUT_FILENO;
+    if (output_file) {
+        output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd == -1)
+            error_exit("open failed when opening output file");
+    }
 
-    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    OutputWriter output;
+    output_init(&output, output_fd);
 
-    int socket_fd = establish_connection(node, port);
+    //A peer closing the connection must not kill the whole crawl
+    signal(SIGPIPE, SIG_IGN);
 
-    SSL *ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, socket_fd);
-    int ret;
-    if ((ret = SSL_connect(ssl)) <= 0) {
-        fprintf(stderr, "SSL_connect() failed.\n");
-        fprintf(stderr, "Error Num: %d\n", SSL_get_error(ssl, ret));
-        return EXIT_FAILURE;
-    }
+    SSL_CTX *ctx = initialize_ssl_context();
+    if (!ctx)
+        error_exit_custom("Unable to initialize the ssl context");
 
-    //TODO: allow for certificate validation
+    PerfReport baseline;
+    if (perf_baseline_file && perf_read_report(perf_baseline_file, &baseline) < 0)
+        error_exit_custom("Unable to read the performance baseline");
 
-    char buffer[BUFFER_SIZE];
+    Capture *capture = capture_file ? capture_open(capture_file) : NULL;
+    Replay *replay = replay_file ? replay_load(replay_file) : NULL;
 
-    //TODO: Create function to construct http header
-    //TODO: Change resource to get from / to whatever path we extract from the given URL
-    sprintf(buffer, "GET / HTTP/1.1\r\nHost: %s\r\nConnection: close\r\nUser-Agent: Spoder\r\n\r\n", node);
+    //The startup state (mostly OpenSSL, which is loaded for http crawls as well) is never freed,
+    //so the cap is checked against it instead of failing somewhere in the setup
+    if (max_memory && memory_total() + TASK_MEMORY_ESTIMATE > max_memory) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "Memory cap of %zu bytes is too small, the startup state alone takes "
+            "%zu bytes, a crawl needs at least %zu bytes", max_memory, memory_total(),
+            memory_total() + TASK_MEMORY_ESTIMATE);
+        error_exit_custom(buffer);
+    }
 
+    memory_set_limit(max_memory);
 
-    int write_ret = SSL_write(ssl, buffer, BUFFER_SIZE);
-    if (write_ret <= 0) //TODO: check if request is retryable and if so, do so
-        error_exit("ssl_write failed");
+    const char *seed_response;
+    size_t seed_response_length;
+    if (replay && replay_find(replay, normalized_url.data, normalized_url.used_size, &seed_response,
+            &seed_response_length) < 0)
+        error_exit_custom("URL has not been captured in the replayed capture");
 
-    TextBuffer *text_buffer = malloc(sizeof(TextBuffer));
-    text_buffer->data = malloc(TEXTBUFFER_SIZE * sizeof(char));
-    text_buffer->available_size = TEXTBUFFER_SIZE;
-    text_buffer->used_size = 0;
+    static PerfReport reports[PERF_MAX_RUNS];
+    u_int32_t runs = 1;
 
-    if (text_buffer->data == NULL)
-        error_exit("malloc failed for text_buffer");
+    Scheduler *scheduler = run_crawl(ctx, &output, &limits, search_recursive, is_verbose, normalized_url.data,
+        normalized_url.used_size, capture, replay, &reports[0]);
 
-    char inside_tag = 0;
-    char fullText = 0;
-    u_short previous_char_blank = 0;
+    int exit_status = scheduler->stats.pages_fetched > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 
-    int bytes;
-    do {
-        memset(buffer, '\0', BUFFER_SIZE);
-        bytes = SSL_read(ssl, buffer, BUFFER_SIZE);
+    if (is_verbose)
+        scheduler_print_stats(scheduler, stderr);
 
+    scheduler_free(scheduler);
 
-        if (bytes < 1) {
-            //TODO: if we still have text inside the text_buffer, parse it
-            printf("%s\n", text_buffer->data);
+    //A single short run is dominated by noise, so a measured replay is repeated. Only the first run is written to the output.
+    if (replay && (perf_report_file || perf_baseline_file)) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd == -1)
+            error_exit("open failed when opening /dev/null");
 
-            fflush(stdout);
-            printf("Connection closed.\n");
-            break;
-        }
+        OutputWriter discarded;
+        output_init(&discarded, null_fd);
 
-        //TODO: section that parses the header, to react to redirect
+        double total_seconds = reports[0].seconds;
 
-        u_int32_t buffer_counter = 0;
+        while (runs < PERF_MAX_RUNS && (runs < perf_runs || total_seconds < PERF_MIN_SECONDS)) {
+            scheduler_free(run_crawl(ctx, &discarded, &limits, search_recursive, is_verbose, normalized_url.data,
+                normalized_url.used_size, NULL, replay, &reports[runs]));
 
-        if (inside_tag) {
-            buffer_counter = search_for_tag_end(buffer, buffer_counter);
+            total_seconds += reports[runs].seconds;
+            runs++;
+        }
 
-            if (buffer_counter == -1) {
-                continue;
-            }
-            inside_tag = 0;
+        output_free(&discarded);
+        close(null_fd);
+    }
 
+    PerfReport report;
+    perf_median(reports, runs, &report);
 
-            //TODO: maybe create a list to store the key="value" pairs inside the tag element
-        }
+    if (perf_report_file) {
+        FILE *report_file = fopen(perf_report_file, "w");
+        if (!report_file)
+            error_exit("fopen failed when writing performance report");
 
-        while (buffer_counter < BUFFER_SIZE ) {
-            if (buffer[buffer_counter] == '<') {
-                //TODO: Parse the text_buffer, if it has content
-                if (text_buffer->used_size > 0)
-                    //initiate_parsing(text_buffer->data);
-
-                //TODO: only clear buffer if it has content otherwise we have a useless operations for cases like <h1><p1>example</p1></h1>
-                if (text_buffer->used_size > 0) {
-                    printf("%s", text_buffer->data);
-                }
-
-
-                //clear and reset text_buffer
-                //TODO: make function for resetting buffer
-                text_buffer->data = (char *) realloc(text_buffer->data, TEXTBUFFER_SIZE * sizeof(char));
-                if (text_buffer->data == NULL)
-                    error_exit("realloc failed when resetting text buffer");
-
-                memset(text_buffer->data, '\0', TEXTBUFFER_SIZE);
-                text_buffer->used_size = 0;
-                text_buffer->available_size = TEXTBUFFER_SIZE;
-
-
-                buffer_counter = search_for_tag_end(buffer, buffer_counter);
-
-                if (buffer_counter == -1) {
-                    inside_tag = 1;
-                    break;
-                }
-                continue;
-            }
-
-
-            if (text_buffer->used_size >= text_buffer->available_size-1) {
-                text_buffer->data = (char *) realloc(text_buffer->data, text_buffer->available_size + (1024 * sizeof(char)));
-                if (text_buffer->data == NULL)
-                    error_exit("realloc failed when expanding text_buffer");
-                text_buffer->available_size += 1024;
-            }
-            char *insert;
-            if(buffer[buffer_counter] == 0xA)  { //LF
-                if (previous_char_blank) {
-                    buffer_counter++;
-                    continue;
-                }
-                *insert = ' ';
-                previous_char_blank = 1;
-            } else if (buffer[buffer_counter] == 0xD || buffer[buffer_counter] == 0x09) { //CR and tab
-                //TODO: create function with all
-                buffer_counter++;
-                continue;
-            } else if (buffer[buffer_counter] == 0x20) { //Blank space
-                if (previous_char_blank) {
-                    buffer_counter++;
-                    continue;
-                }
-                *insert = ' ';
-                previous_char_blank = 1;
-            } else {
-                previous_char_blank = 0;
-                insert = &buffer[buffer_counter];
-            }
-
-            strncat(text_buffer->data, insert, 1);
-            text_buffer->used_size++;
-
-            buffer_counter++;
-        }
+        perf_write_report(&report, report_file);
+        fclose(report_file);
+    }
 
-    } while (bytes > 0);
+    //A regression fails the run, so replays can be used as performance test. A comparison that
+    //can not be made fails as well, a gate that passes without comparing anything is worse.
+    if (perf_baseline_file && report.seconds < PERF_MIN_RUN_SECONDS) {
+        fprintf(stderr, "[ERROR]: ./spoder: Replay took %.2f ms, too short to compare with the baseline, "
+            "use a capture with more pages\n", report.seconds * 1000);
+        exit_status = EXIT_FAILURE;
+    } else if (perf_baseline_file && perf_compare(&report, &baseline, perf_threshold, stderr) > 0)
+        exit_status = EXIT_FAILURE;
 
+    capture_close(capture);
+    replay_free(replay);
 
-    SSL_shutdown(ssl);
-    SSL_free(ssl);
     SSL_CTX_free(ctx);
-    close(socket_fd);
+
+    output_free(&output);
+    if (output_fd != STDOUT_FILENO)
+        close(output_fd);
 
     if (custom_port_provided) {
         free(port);
@@ -355,14 +634,10 @@ int main(int argc, char **argv)
         output_file = NULL;
     }
 
-    free(text_buffer);
-    text_buffer = NULL;
-
     free(url);
     url = NULL;
-    
-    free(node);
-    node = NULL;
 
-    return EXIT_SUCCESS;
+    text_buffer_free(&normalized_url);
+    
+    return exit_status;
 }
\ No newline at end of file
@@ -0,0 +1,571 @@
+#include <ctype.h>
+#include <stdint.h>
+
+#include "url.h"
+
+#define HOST_TABLE_INITIAL_SLOTS 64
+#define HOST_TABLE_INITIAL_NAMES 1024
+
+
+static int is_scheme_char(char c)
+{
+    return isalnum((unsigned char) c) || c == '+' || c == '-' || c == '.';
+}
+
+/**
+ * @brief Split the given URL into its components (RFC 3986, section 3) in a single pass.
+ *  Nothing is copied, the components are returned as spans into the given string.
+ *
+ * @param url URL or relative reference to be parsed, does not have to be null terminated
+ * @param length length of the url
+ * @param components filled with the spans of all components, check flags for the
+ *  components that are defined
+ * @return int 0 if the url could be parsed, -1 if it is malformed
+ */
+int parse_url(const char *url, size_t length, UrlComponents *components)
+{
+    memset(components, 0, sizeof(UrlComponents));
+
+    if (length > UINT32_MAX)
+        return -1;
+
+    u_int32_t i = 0;
+
+    //scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ) ":"
+    if (length > 0 && isalpha((unsigned char) url[0])) {
+        u_int32_t j = 1;
+        while (j < length && is_scheme_char(url[j]))
+            ++j;
+
+        if (j < length && url[j] == ':') {
+            components->scheme.length = j;
+            components->flags |= URL_HAS_SCHEME;
+            i = j + 1;
+        }
+    }
+
+    if (i + 1 < length && url[i] == '/' && url[i+1] == '/') {
+        i += 2;
+        components->flags |= URL_HAS_AUTHORITY;
+
+        u_int32_t host_start = i;
+        u_int32_t colon = 0;
+        short inside_brackets = 0;
+
+        for (; i < length && url[i] != '/' && url[i] != '?' && url[i] != '#'; ++i) {
+            if (url[i] == '@') {
+                components->userinfo.offset = host_start;
+                components->userinfo.length = i - host_start;
+                components->flags |= URL_HAS_USERINFO;
+                host_start = i + 1;
+                colon = 0;
+            } else if (url[i] == '[') {
+                inside_brackets = 1;
+            } else if (url[i] == ']') {
+                inside_brackets = 0;
+            } else if (url[i] == ':' && !inside_brackets) {
+                colon = i;
+            }
+        }
+
+        components->host.offset = host_start;
+        components->host.length = (colon ? colon : i) - host_start;
+
+        if (colon) {
+            components->port.offset = colon + 1;
+            components->port.length = i - colon - 1;
+            components->flags |= URL_HAS_PORT;
+
+            for (u_int32_t p = colon + 1; p < i; ++p) {
+                if (!isdigit((unsigned char) url[p]))
+                    return -1;
+            }
+        }
+    }
+
+    components->path.offset = i;
+    for (; i < length && url[i] != '?' && url[i] != '#'; ++i)
+        ;
+    components->path.length = i - components->path.offset;
+
+    if (i < length && url[i] == '?') {
+        components->query.offset = ++i;
+        components->flags |= URL_HAS_QUERY;
+        for (; i < length && url[i] != '#'; ++i)
+            ;
+        components->query.length = i - components->query.offset;
+    }
+
+    if (i < length && url[i] == '#') {
+        components->fragment.offset = ++i;
+        components->fragment.length = length - i;
+        components->flags |= URL_HAS_FRAGMENT;
+    }
+
+    return 0;
+}
+
+static int span_equals_ignore_case(const char *url, UrlSpan span, const char *value)
+{
+    size_t value_length = strlen(value);
+
+    if (span.length != value_length)
+        return 0;
+
+    for (u_int32_t i = 0; i < span.length; ++i) {
+        if (tolower((unsigned char) url[span.offset + i]) != value[i])
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Get the port of the given http or https URL, falling back to the default port
+ *  of the scheme if no port is specified.
+ *
+ * @param url parsed url
+ * @param components components of the url
+ * @return u_int16_t port, 0 if the port is invalid or the scheme is neither http nor https
+ */
+u_int16_t url_port(const char *url, const UrlComponents *components)
+{
+    if (components->flags & URL_HAS_PORT && components->port.length > 0) {
+        unsigned long port = 0;
+
+        for (u_int32_t i = 0; i < components->port.length; ++i) {
+            port = port * 10 + (url[components->port.offset + i] - '0');
+            if (port > 65535)
+                return 0;
+        }
+        return (u_int16_t) port;
+    }
+
+    if (span_equals_ignore_case(url, components->scheme, "https"))
+        return 443;
+
+    if (span_equals_ignore_case(url, components->scheme, "http"))
+        return 80;
+
+    return 0;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int is_unreserved(char c)
+{
+    return isalnum((unsigned char) c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/**
+ * @brief Append path or query to the buffer, normalizing percent-encodings on the way:
+ *  encoded unreserved characters are decoded and all other hex digits are written in uppercase.
+ */
+static void append_percent_normalized(TextBuffer *out, const char *src, u_int32_t length)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+
+    //Every character is written as at most three characters
+    text_buffer_reserve(out, 3 * (size_t) length);
+
+    for (u_int32_t i = 0; i < length; ++i) {
+        char c = src[i];
+
+        if (c == '%' && i + 2 < length) {
+            int high = hex_value(src[i+1]);
+            int low = hex_value(src[i+2]);
+
+            if (high >= 0 && low >= 0) {
+                char decoded = (char) (high * 16 + low);
+
+                if (is_unreserved(decoded)) {
+                    out->data[out->used_size++] = decoded;
+                } else {
+                    out->data[out->used_size++] = '%';
+                    out->data[out->used_size++] = hex_digits[high];
+                    out->data[out->used_size++] = hex_digits[low];
+                }
+                i += 2;
+                continue;
+            }
+        }
+
+        //Whitespace is not allowed inside an URL, encode it instead of failing
+        if (c == ' ') {
+            text_buffer_append(out, "%20", 3);
+            continue;
+        }
+
+        out->data[out->used_size++] = c;
+    }
+
+    out->data[out->used_size] = '\0';
+}
+
+/**
+ * @brief Remove the dot segments of a path in place (RFC 3986, section 5.2.4).
+ *
+ * @param path path to be normalized
+ * @param length length of the path
+ * @return size_t length of the path after removing all dot segments
+ */
+static size_t remove_dot_segments(char *path, size_t length)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length) {
+        size_t remaining = length - in;
+        char *p = &path[in];
+
+        if (remaining >= 3 && strncmp(p, "../", 3) == 0) {
+            in += 3;
+        } else if (remaining >= 2 && strncmp(p, "./", 2) == 0) {
+            in += 2;
+        } else if (remaining >= 3 && strncmp(p, "/./", 3) == 0) {
+            in += 2;
+        } else if (remaining == 2 && strncmp(p, "/.", 2) == 0) {
+            in = length;
+            path[out++] = '/';
+        } else if (remaining >= 4 && strncmp(p, "/../", 4) == 0) {
+            in += 3;
+            while (out > 0 && path[out-1] != '/')
+                --out;
+            if (out > 0)
+                --out;
+        } else if (remaining == 3 && strncmp(p, "/..", 3) == 0) {
+            in = length;
+            while (out > 0 && path[out-1] != '/')
+                --out;
+            if (out > 0)
+                --out;
+            path[out++] = '/';
+        } else if ((remaining == 1 && *p == '.') || (remaining == 2 && strncmp(p, "..", 2) == 0)) {
+            in = length;
+        } else {
+            do {
+                path[out++] = path[in++];
+            } while (in < length && path[in] != '/');
+        }
+    }
+
+    return out;
+}
+
+/**
+ * @brief Resolve a reference against a base URL (RFC 3986, section 5.2) and write the
+ *  normalized result into the buffer. The scheme and host are lowercased, default ports,
+ *  dot segments and the fragment are removed and an empty path is replaced by '/'.
+ *
+ * @param base base url, may be NULL if the reference is an absolute url
+ * @param base_components components of the base url, may be NULL if base is NULL
+ * @param reference reference to be resolved (e.g. the value of a href attribute)
+ * @param reference_length length of the reference
+ * @param out buffer the resolved url is written to, the buffer is reset beforehand
+ * @return int 0 on success, -1 if the reference is malformed, does not resolve to a
+ *  http or https url or the memory cap has been reached
+ */
+int resolve_url(const char *base, const UrlComponents *base_components,
+    const char *reference, size_t reference_length, TextBuffer *out)
+{
+    //Leading and trailing whitespace in attribute values is ignored by browsers as well
+    while (reference_length > 0 && isspace((unsigned char) *reference)) {
+        ++reference;
+        --reference_length;
+    }
+    while (reference_length > 0 && isspace((unsigned char) reference[reference_length-1]))
+        --reference_length;
+
+    UrlComponents ref;
+    if (parse_url(reference, reference_length, &ref) < 0)
+        return -1;
+
+    const char *scheme_src = reference;
+    const char *authority_src = reference;
+    const char *query_src = reference;
+    const UrlComponents *authority = &ref;
+    UrlSpan query = ref.query;
+    short has_query = (ref.flags & URL_HAS_QUERY) != 0;
+    short merge_path = 0;
+    short use_base_path = 0;
+
+    if (!(ref.flags & URL_HAS_SCHEME)) {
+        if (base == NULL || base_components == NULL)
+            return -1;
+
+        scheme_src = base;
+
+        if (!(ref.flags & URL_HAS_AUTHORITY)) {
+            authority_src = base;
+            authority = base_components;
+
+            if (ref.path.length == 0) {
+                use_base_path = 1;
+                if (!has_query) {
+                    query_src = base;
+                    query = base_components->query;
+                    has_query = (base_components->flags & URL_HAS_QUERY) != 0;
+                }
+            } else if (reference[ref.path.offset] != '/') {
+                merge_path = 1;
+            }
+        }
+    }
+
+    const UrlComponents *scheme = scheme_src == base ? base_components : &ref;
+    short is_https = span_equals_ignore_case(scheme_src, scheme->scheme, "https");
+
+    if (!is_https && !span_equals_ignore_case(scheme_src, scheme->scheme, "http"))
+        return -1;
+
+    if (!(authority->flags & URL_HAS_AUTHORITY) || authority->host.length == 0)
+        return -1;
+
+    u_int16_t default_port = is_https ? 443 : 80;
+    u_int16_t port = default_port;
+
+    if (authority->flags & URL_HAS_PORT && authority->port.length > 0) {
+        port = url_port(authority_src, authority);
+        if (port == 0)
+            return -1;
+    }
+
+    text_buffer_reset(out);
+
+    //Reserve the longest possible result up front, so none of the appends below can fail
+    size_t max_length = 8 + authority->userinfo.length + 1 + authority->host.length + 8
+        + 3 * ((size_t) ref.path.length + (base_components ? base_components->path.length : 0)) + 2
+        + 1 + 3 * (size_t) query.length;
+    if (text_buffer_reserve(out, max_length) < 0)
+        return -1;
+
+    text_buffer_append(out, is_https ? "https://" : "http://", is_https ? 8 : 7);
+
+    if (authority->flags & URL_HAS_USERINFO) {
+        text_buffer_append(out, &authority_src[authority->userinfo.offset], authority->userinfo.length);
+        text_buffer_append(out, "@", 1);
+    }
+
+    size_t host_start = out->used_size;
+    text_buffer_append(out, &authority_src[authority->host.offset], authority->host.length);
+    for (size_t i = host_start; i < out->used_size; ++i)
+        out->data[i] = (char) tolower((unsigned char) out->data[i]);
+
+    if (port != default_port) {
+        char port_buffer[8];
+        int port_length = sprintf(port_buffer, ":%u", (unsigned int) port);
+        text_buffer_append(out, port_buffer, port_length);
+    }
+
+    size_t path_start = out->used_size;
+
+    if (use_base_path) {
+        append_percent_normalized(out, &base[base_components->path.offset], base_components->path.length);
+    } else if (merge_path) {
+        const char *base_path = &base[base_components->path.offset];
+        u_int32_t base_path_length = base_components->path.length;
+
+        if (base_path_length == 0) {
+            text_buffer_append(out, "/", 1);
+        } else {
+            while (base_path_length > 0 && base_path[base_path_length-1] != '/')
+                --base_path_length;
+            append_percent_normalized(out, base_path, base_path_length);
+        }
+        append_percent_normalized(out, &reference[ref.path.offset], ref.path.length);
+    } else {
+        append_percent_normalized(out, &reference[ref.path.offset], ref.path.length);
+    }
+
+    out->used_size = path_start + remove_dot_segments(&out->data[path_start], out->used_size - path_start);
+    if (out->used_size == path_start)
+        text_buffer_append(out, "/", 1);
+    out->data[out->used_size] = '\0';
+
+    if (has_query) {
+        text_buffer_append(out, "?", 1);
+        append_percent_normalized(out, &query_src[query.offset], query.length);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Normalize an absolute http or https URL, see resolve_url.
+ *
+ * @param url url to be normalized
+ * @param length length of the url
+ * @param out buffer the normalized url is written to
+ * @return int 0 on success, -1 if the url is malformed or not a http or https url
+ */
+int normalize_url(const char *url, size_t length, TextBuffer *out)
+{
+    return resolve_url(NULL, NULL, url, length, out);
+}
+
+
+static u_int32_t hash_host(const char *host, size_t length)
+{
+    //FNV-1a, hosts are hashed case insensitive
+    u_int32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) tolower((unsigned char) host[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int host_matches(const HostTable *table, u_int32_t id, const char *host, size_t length)
+{
+    const char *name = &table->names[table->offsets[id]];
+
+    for (size_t i = 0; i < length; ++i) {
+        if (name[i] == '\0' || name[i] != tolower((unsigned char) host[i]))
+            return 0;
+    }
+    return name[length] == '\0';
+}
+
+static int host_table_grow(HostTable *table)
+{
+    u_int32_t slot_count = table->slot_count * 2;
+    u_int32_t *slots = mem_calloc(MEMORY_HOSTS, slot_count, sizeof(u_int32_t));
+    u_int32_t *offsets = mem_realloc(MEMORY_HOSTS, table->offsets, (slot_count / 2) * sizeof(u_int32_t));
+
+    if (offsets)
+        table->offsets = offsets;
+
+    if (!slots || !offsets) {
+        mem_free(slots);
+        return -1;
+    }
+
+    for (u_int32_t id = 0; id < table->count; ++id) {
+        const char *name = &table->names[table->offsets[id]];
+        u_int32_t slot = hash_host(name, strlen(name)) & (slot_count - 1);
+
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = id + 1;
+    }
+
+    mem_free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return 0;
+}
+
+/**
+ * @brief Create an empty table for interning host names.
+ *
+ * @return HostTable* the table, has to be freed with host_table_free
+ */
+HostTable *host_table_create(void)
+{
+    HostTable *table = mem_alloc(MEMORY_HOSTS, sizeof(HostTable));
+    if (!table)
+        error_exit("malloc failed when creating host table");
+
+    table->names = mem_alloc(MEMORY_HOSTS, HOST_TABLE_INITIAL_NAMES * sizeof(char));
+    table->names_size = HOST_TABLE_INITIAL_NAMES;
+    table->names_used = 0;
+    table->offsets = mem_alloc(MEMORY_HOSTS, (HOST_TABLE_INITIAL_SLOTS / 2) * sizeof(u_int32_t));
+    table->count = 0;
+    table->slots = mem_calloc(MEMORY_HOSTS, HOST_TABLE_INITIAL_SLOTS, sizeof(u_int32_t));
+    table->slot_count = HOST_TABLE_INITIAL_SLOTS;
+
+    if (!table->names || !table->offsets || !table->slots)
+        error_exit("malloc failed when creating host table");
+
+    return table;
+}
+
+/**
+ * @brief Intern the given host name. Host names are compared case insensitive, so
+ *  EXAMPLE.com and example.com map to the same id.
+ *
+ * @param table table the host is interned in
+ * @param host host name, does not have to be null terminated
+ * @param length length of the host name
+ * @return u_int32_t id of the host, ids are assigned consecutively starting at 0,
+ *  HOST_TABLE_FULL if the host is new and the memory cap has been reached
+ */
+u_int32_t host_table_intern(HostTable *table, const char *host, size_t length)
+{
+    u_int32_t slot = hash_host(host, length) & (table->slot_count - 1);
+
+    while (table->slots[slot] != 0) {
+        u_int32_t id = table->slots[slot] - 1;
+        if (host_matches(table, id, host, length))
+            return id;
+        slot = (slot + 1) & (table->slot_count - 1);
+    }
+
+    if (table->names_used + length + 1 > table->names_size) {
+        size_t names_size = table->names_size;
+        while (table->names_used + length + 1 > names_size)
+            names_size *= 2;
+
+        char *names = mem_realloc(MEMORY_HOSTS, table->names, names_size * sizeof(char));
+        if (!names)
+            return HOST_TABLE_FULL;
+
+        table->names = names;
+        table->names_size = names_size;
+    }
+
+    //Keep the load factor below 1/2, the new host then has to be put into the grown table
+    if (table->count + 1 >= table->slot_count / 2) {
+        if (host_table_grow(table) < 0)
+            return HOST_TABLE_FULL;
+
+        slot = hash_host(host, length) & (table->slot_count - 1);
+        while (table->slots[slot] != 0)
+            slot = (slot + 1) & (table->slot_count - 1);
+    }
+
+    u_int32_t id = table->count++;
+    table->offsets[id] = (u_int32_t) table->names_used;
+    for (size_t i = 0; i < length; ++i)
+        table->names[table->names_used++] = (char) tolower((unsigned char) host[i]);
+    table->names[table->names_used++] = '\0';
+
+    table->slots[slot] = id + 1;
+
+    return id;
+}
+
+/**
+ * @brief Get the (lowercased) host name of an interned host.
+ *
+ * @param table table the host was interned in
+ * @param id id returned by host_table_intern
+ * @return const char* host name, NULL if the id is unknown
+ */
+const char *host_table_name(const HostTable *table, u_int32_t id)
+{
+    if (id >= table->count)
+        return NULL;
+
+    return &table->names[table->offsets[id]];
+}
+
+void host_table_free(HostTable *table)
+{
+    if (!table)
+        return;
+
+    mem_free(table->names);
+    mem_free(table->offsets);
+    mem_free(table->slots);
+    mem_free(table);
+}
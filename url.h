@@ -0,0 +1,63 @@
+#ifndef LIBURL
+#define LIBURL
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "utilities.h"
+
+#define URL_HAS_SCHEME    0x01
+#define URL_HAS_AUTHORITY 0x02
+#define URL_HAS_USERINFO  0x04
+#define URL_HAS_PORT      0x08
+#define URL_HAS_QUERY     0x10
+#define URL_HAS_FRAGMENT  0x20
+
+/* Returned by host_table_intern if a new host can not be interned because of the memory cap */
+#define HOST_TABLE_FULL UINT32_MAX
+
+/* A component of an URL, given as offset and length into the parsed string. */
+typedef struct UrlSpan {
+    u_int32_t offset;
+    u_int32_t length;
+} UrlSpan;
+
+typedef struct UrlComponents {
+    UrlSpan scheme;
+    UrlSpan userinfo;
+    UrlSpan host;
+    UrlSpan port;
+    UrlSpan path;
+    UrlSpan query;
+    UrlSpan fragment;
+    u_int8_t flags;
+} UrlComponents;
+
+typedef struct HostTable {
+    char *names;            /* all interned hosts, each terminated by '\0' */
+    size_t names_size;
+    size_t names_used;
+    u_int32_t *offsets;     /* id -> offset into names */
+    u_int32_t count;
+    u_int32_t *slots;       /* open addressing, stores id+1, 0 marks an empty slot */
+    u_int32_t slot_count;
+} HostTable;
+
+int parse_url(const char *url, size_t length, UrlComponents *components);
+
+int resolve_url(const char *base, const UrlComponents *base_components,
+    const char *reference, size_t reference_length, TextBuffer *out);
+
+int normalize_url(const char *url, size_t length, TextBuffer *out);
+
+u_int16_t url_port(const char *url, const UrlComponents *components);
+
+HostTable *host_table_create(void);
+
+u_int32_t host_table_intern(HostTable *table, const char *host, size_t length);
+
+const char *host_table_name(const HostTable *table, u_int32_t id);
+
+void host_table_free(HostTable *table);
+
+#endif
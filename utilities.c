@@ -61,24 +61,6 @@ short check_url_protocol(const char *url)
     return -1;
 }
 
-/**
- * @brief Return the URL without the protocol, e.g. http://example.com -> return: example.com
- *      If the protocol is not recognized, NULL is returned
- * 
- * @param url url of which the protocoll should be stripped
- * @return char* url without protocol
- */
-char *url_without_protocol(const char *url)
-{
-    if (strncmp(url, "http://", strlen("http://")) == 0)
-        return strdup(&url[7]);
-
-    if (strncmp(url, "https://", strlen("https://")) == 0)
-        return strdup(&url[8]);
-
-    return NULL;
-}
-
 /**
  * @brief Checks if the given URL is valid or not.
  * 
@@ -86,7 +68,7 @@ char *url_without_protocol(const char *url)
  */
 void check_valid_url(const char *url)
 {
-    char *regex_expression = "[a-zA-Z0-9.-]+\\.[a-zA-Z]{2,63}(/[^[:space:]]*)?$";
+    char *regex_expression = "[a-zA-Z0-9.-]+\\.[a-zA-Z]{2,63}(:[0-9]+)?(/[^[:space:]]*)?$";
 
     regex_t regex;
     int rc;
@@ -106,97 +88,91 @@ void check_valid_url(const char *url)
 }
 
 /**
- * @brief Find the character that terminates the host name in the specified url
+ * @brief Make sure that at least the specified amount of characters (plus the terminating
+ *  null byte) can be appended to the buffer without reallocating.
  * 
- * @param url url of which the character that terminates its contained hostname should be found
- * @return char* pointer to the char that occurs first out of '/', '?' and '#'. If none of these
- *  chars is found in the url, NULL is returned.
+ * @param buffer buffer to be grown if necessary
+ * @param additional_size amount of characters that will be appended
+ * @return int 0 on success, -1 if the memory cap has been reached (the buffer is unchanged)
  */
-static char *host_terminating_character(const char *url)
+int text_buffer_reserve(TextBuffer *buffer, size_t additional_size)
 {
+    size_t required_size = buffer->used_size + additional_size + 1;
 
-    int question_mark_index = INT_MAX;
-    int slash_index = INT_MAX;
-    int hashtag_index = INT_MAX;
-
-    char *question_mark = strchr(url, '?');
-    if (question_mark)
-        question_mark_index = (int) (question_mark - url);
-
-    char *hashtag = strchr(url, '#');
-    if (hashtag)
-        hashtag_index = (int) (hashtag - url);
+    if (required_size <= buffer->available_size)
+        return 0;
 
-    char *slash = strchr(url, '/');
-    if (slash)
-        slash_index = (int) (slash - url);
-
-    if (question_mark_index < slash_index && question_mark_index < hashtag_index)
-        return question_mark;
-    
-    
-    if (hashtag_index < question_mark_index && hashtag_index < slash_index)
-        return hashtag;
-        
+    size_t new_size = buffer->available_size ? buffer->available_size : 64;
+    while (new_size < required_size)
+        new_size *= 2;
 
-    if ((slash_index < question_mark_index) && (slash_index < hashtag_index))
-        return slash;
+    char *data = mem_realloc(buffer->subsystem, buffer->data, new_size * sizeof(char));
+    if (data == NULL)
+        return -1;
 
-    return NULL;
+    buffer->data = data;
+    buffer->available_size = new_size;
+    return 0;
 }
 
 /**
- * @brief Extract node from the url (e.g. www.example.com/f1/f2/f3 -> www.example.com)
+ * @brief Append the given characters to the buffer and keep it null terminated.
  * 
- * @param url URL from which the node should be extracted.
- * @return char* the extracted node. The node has to be freed.
+ * @param buffer buffer to append to
+ * @param data characters to be appended, do not have to be null terminated
+ * @param length amount of characters to be appended
+ * @return int 0 on success, -1 if the memory cap has been reached (nothing is appended)
  */
-char *extract_node(const char *url)
+int text_buffer_append(TextBuffer *buffer, const char *data, size_t length)
 {
-    char *node;
-    char *delimeter = host_terminating_character(url);
-
-    if (delimeter != NULL) {
-        u_int32_t index = (int) (delimeter - url);
-        node = malloc(sizeof(char) * (index+1));
-
-        if (!node)
-            error_exit("malloc failed when extracting node");
-        
-        memset(node, '\0', sizeof(node));
-        strncpy(node, url, index);
-    } else {
-        node = strdup(url);
-    }
+    if (text_buffer_reserve(buffer, length) < 0)
+        return -1;
 
-    //Only search for '/' to end the host name
-    /*if (strchr(url, '/') != NULL) {
-        int index_of_first_slash = (int) ((strchr(url, '/')) - url);
-        node = malloc(sizeof(char) * (index_of_first_slash+1));
+    memcpy(&buffer->data[buffer->used_size], data, length);
+    buffer->used_size += length;
+    buffer->data[buffer->used_size] = '\0';
+    return 0;
+}
 
-        if (!node)
-            error_exit("malloc failed when extracting the node");
+/**
+ * @brief Empty the buffer without releasing its memory.
+ * 
+ * @param buffer buffer to be reset
+ */
+void text_buffer_reset(TextBuffer *buffer)
+{
+    buffer->used_size = 0;
+    if (buffer->data)
+        buffer->data[0] = '\0';
+}
 
-        memset(node, '\0', sizeof(node));
-        strncpy(node, url, index_of_first_slash);
-    } else {
-        node = strdup(url);
-    }*/
+/**
+ * @brief Release the memory of the buffer, the buffer can be reused afterwards.
+ * 
+ * @param buffer buffer to be freed
+ */
+void text_buffer_free(TextBuffer *buffer)
+{
+    mem_free(buffer->data);
 
-    return node;
+    buffer->data = NULL;
+    buffer->available_size = 0;
+    buffer->used_size = 0;
 }
 
 /**
- * @brief 
+ * @brief Get the current time of a monotonic clock, used for timeouts and deadlines.
  * 
- * @param url 
- * @return char* Returns path, if no path is given '/' is returned to request the root
+ * @return u_int64_t milliseconds since an unspecified starting point
  */
-char *extract_path(const char *url)
+u_int64_t monotonic_ms(void)
 {
-    char *path;
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+        error_exit("clock_gettime failed");
 
-    //TODO: implement
+    return (u_int64_t) now.tv_sec * 1000 + (u_int64_t) now.tv_nsec / 1000000;
 }
 
 //TODO: also pass an array where you can define custom headers
@@ -7,11 +7,16 @@
 #include <regex.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "memory.h"
 
 typedef struct TextBuffer {
     char *data;
     size_t available_size; //TODO: maybe rename to total_size
     size_t used_size;
+    u_int8_t subsystem;     /* MemorySubsystem the data is accounted to, MEMORY_TEXT by default */
 } TextBuffer;
 
 void error_exit(const char* msg);
@@ -24,9 +29,15 @@ short check_url_protocol(const char* url);
 
 void check_valid_url(const char *url);
 
-char* url_without_protocol(const char* url);
+int text_buffer_reserve(TextBuffer *buffer, size_t additional_size);
+
+int text_buffer_append(TextBuffer *buffer, const char *data, size_t length);
+
+void text_buffer_reset(TextBuffer *buffer);
+
+void text_buffer_free(TextBuffer *buffer);
 
-char* extract_node(const char* url);
+u_int64_t monotonic_ms(void);
 
 short search_for_tag_end(char *buffer, u_short buffer_counter);
 